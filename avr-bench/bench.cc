@@ -0,0 +1,183 @@
+// Cycle counts for the hot kernels of dstrand-waterfall on real AVR
+// targets, run under simavr.  See the Makefile.
+//
+// The sketch is compiled as-is (with stubs/ standing in for the Arduino
+// core) so the kernels are exactly what ships.
+// Each result is the average over kReps calls with the cost of the
+// empty harness loop subtracted.
+//
+// RAM use is reported last: static data, the heap once the sketch has
+// set up everything it allocates, and the peak over the whole run, which
+// must leave kRamMargin bytes free.
+
+#include <stdint.h>
+
+#include "avr_mcu_section.h"
+
+#include "../dstrand-waterfall/digital-strand.cc"
+#include "cycle_counter.h"
+
+AVR_MCU(F_CPU, BENCH_MCU);
+AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+
+#define kReps 256
+
+// Left for the Arduino core's interrupts and paths the bench doesn't take.
+#define kRamMargin 64
+
+/*****************************************************************************/
+// Benches.  Inputs are read from volatiles so nothing gets folded away.
+
+volatile byte inA = 10;
+volatile byte inB = 200;
+volatile byte inC = 3;
+volatile byte sink;
+
+uint32_t EmptyLoop() {
+  uint32_t start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    sink = inA + inB + inC + i;
+  }
+  return Cycles() - start;
+}
+
+uint32_t BenchMoveToTarget() {
+  uint32_t start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    sink = MoveToTarget(inA + i, inB, inC);
+  }
+  return Cycles() - start;
+}
+
+uint32_t BenchSetStep() {
+  uint32_t start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    sink = SetStep(inB + i, inA) + inC;
+  }
+  return Cycles() - start;
+}
+
+uint32_t BenchWheel() {
+  uint32_t start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    Color c = Wheel((inA + i + inC) + (uint16_t)inB % 128);
+    sink = c.GetRed();
+  }
+  return Cycles() - start;
+}
+
+uint32_t BenchNoise3D() {
+  uint32_t start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    sink = Noise3D(inA * i, inB + i, inC);
+  }
+  return Cycles() - start;
+}
+
+int main() {
+  PaintRam();
+  StartCounter();
+  uint32_t empty = EmptyLoop();
+
+  Report("MoveToTarget/call", (BenchMoveToTarget() - empty) / kReps);
+  Report("SetStep/call", (BenchSetStep() - empty) / kReps);
+  Report("Wheel/call", (BenchWheel() - empty) / kReps);
+  Report("Noise3D/call", (BenchNoise3D() - empty) / kReps);
+
+  // One noiseCycle() frame's worth of field for the 8 x 22 installation;
+  // at 16 MHz a 30 fps frame is 533333 cycles.
+  uint8_t values[kNoiseChunk];
+  uint32_t start = Cycles();
+  for (uint8_t i = 0; i < 176; i += kNoiseChunk) {
+    NoiseRow(i * kNoiseScale, kNoiseScale, inA, inB, values,
+             176 - i < kNoiseChunk ? 176 - i : kNoiseChunk);
+  }
+  sink = values[0];
+  Report("NoiseRow/frame-176px", Cycles() - start);
+
+#if RAMEND > 0x800
+  // The strip needs more RAM than an ATtiny85 has.
+  setup();
+
+  // The sketch's pins are the SPI port, so show() returns once the frame
+  // has started and the rest goes out from the interrupt.
+  start = Cycles();
+  mystrip->show();
+  uint32_t started = Cycles();
+  mystrip->waitForShow();
+  uint32_t sent = Cycles();
+  Report("ArduinoStrip::show/frame", started - start);
+  Report("ArduinoStrip::show/frame-sent", sent - start);
+
+  // A whole rainbowCycle() is 384 frames of Wheel + setPixelColor + show.
+  start = Cycles();
+  rainbowCycle();
+  Report("rainbowCycle/frame", (Cycles() - start) / 384);
+
+  // Blending layeredCycle()'s two upper layers into the wheel, with the
+  // layers it allocates.
+  if (LayersReady(nLEDS)) {
+    compositor->SetOpacity(kLayerBlue, inB);
+    start = Cycles();
+    compositor->Composite(composite);
+    sink = composite[0];
+    Report("Compositor::Composite/frame", Cycles() - start);
+  }
+
+  // One frame of sound analysis on a square wave.  rainbowCycle() adds
+  // this and the ~8 ms capture to each frame when it reacts to sound; a
+  // 30 fps frame is 533333 cycles.
+  int16_t samples[kAudioFftSize];
+  for (uint8_t i = 0; i < kAudioFftSize; i++) {
+    samples[i] = (i + inC) & 4 ? 12000 : -12000;
+  }
+  start = Cycles();
+  audio.Analyze(samples);
+  Report("AudioAnalyzer::Analyze/frame", Cycles() - start);
+  sink = audio.bass();
+
+  // rainbowCycle() reacting to sound, a frame at a time: analysis,
+  // render and send.  The board's capture takes another kAudioFftSize
+  // sample periods of real time (the stub here returns at once), so this
+  // has to fit in what that leaves of a 33 ms frame.
+  audioActive = true;
+  start = Cycles();
+  rainbowCycle();
+  ReportWithin("rainbowCycle+audio/frame", (Cycles() - start) / 384,
+               F_CPU / 1000 * 33
+                   - (uint32_t)kAudioFftSize * (F_CPU / kAudioSampleRate));
+  audioActive = false;
+
+  // A full pool of particles, each long-lived enough to survive the frame.
+  particles.Clear();
+  while (particles.Spawn((ParticleRandom() % nLEDS) << 8, inA, 200, 96, 96,
+                         96)) {
+  }
+  start = Cycles();
+  particles.Render(mystrip, nLEDS);
+  particles.Update(8, nLEDS);
+  Report("ParticlePool/frame-24", Cycles() - start);
+
+  // Setting a pixel also keeps the strip's power estimate current.
+  start = Cycles();
+  for (uint16_t i = 0; i < kReps; i++) {
+    mystrip->setPixelColor(i % nLEDS, inA + i, inB, inC);
+  }
+  Report("Strip::setPixelColor/call", (Cycles() - start - empty) / kReps);
+#endif
+
+  // The per-frame estimate, on a frame over budget so it has to work out
+  // the scale too.
+  PowerBudget bench_power(kPowerLpd8806);
+  bench_power.SetLimit(nLEDS, nSTRIPS, 500);
+  start = Cycles();
+  sink = bench_power.Frame(inA * 300UL, inB);
+  Report("PowerBudget::Frame/limited", Cycles() - start);
+
+  Report("ram/static", RamStatic());
+  Report("ram/heap", RamHeap());
+  ReportWithin("ram/peak", RamPeak(), RAMEND + 1 - RAMSTART - kRamMargin);
+
+  Finish();
+  return 0;
+}
@@ -0,0 +1,161 @@
+#ifndef AVR_BENCH_CYCLE_COUNTER_H
+#define AVR_BENCH_CYCLE_COUNTER_H
+
+// Cycle counting, RAM accounting and result output shared by the benches.
+//
+// Timings come from a free-running hardware timer.  Results go to
+// simavr's console register (set up by AVR_MCU_SIMAVR_CONSOLE in each
+// bench) as lines of
+//   BENCH <name> <value>
+// which the Makefile collects.  ReportWithin() also checks a result
+// against a limit; a bench with any result over its limit finishes with
+// "done <count>" instead of "done 0", which fails the run.
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <stdint.h>
+
+volatile uint16_t counterOverflows = 0;
+
+#if defined(TIMSK1)
+// ATmega: 16-bit Timer1 at clk/1; one overflow interrupt per 65536 cycles.
+ISR(TIMER1_OVF_vect) {
+  counterOverflows++;
+}
+
+void StartCounter() {
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TIMSK1 = _BV(TOIE1);
+  sei();
+}
+
+uint32_t Cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t low = TCNT1;
+  uint32_t high = counterOverflows;
+  if ((TIFR1 & _BV(TOV1)) && low < 0x8000) {
+    high++;
+  }
+  SREG = sreg;
+  return (high << 16) | low;
+}
+#else
+// ATtiny85 has no 16-bit timer; Timer0 at clk/8 keeps the overflow
+// interrupt down to one per 2048 cycles (about 1% overhead).
+ISR(TIMER0_OVF_vect) {
+  counterOverflows++;
+}
+
+void StartCounter() {
+  TCCR0A = 0;
+  TCCR0B = _BV(CS01);
+  TIMSK = _BV(TOIE0);
+  sei();
+}
+
+uint32_t Cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t low = TCNT0;
+  uint32_t high = counterOverflows;
+  if ((TIFR & _BV(TOV0)) && low < 0x80) {
+    high++;
+  }
+  SREG = sreg;
+  return ((high << 8) | low) << 3;
+}
+#endif
+
+/*****************************************************************************/
+// RAM.  PaintRam() fills everything between the heap and the stack with a
+// marker, first thing in main(); whatever is still marked at the end was
+// never used by the heap or the stack.
+
+extern char __heap_start;
+extern char* __brkval;
+
+#define kRamPaint 0xa5
+
+void PaintRam() {
+  char here;
+  for (char* p = &__heap_start; p < &here - 32; p++) {
+    *p = kRamPaint;
+  }
+}
+
+// .data and .bss.
+uint16_t RamStatic() {
+  return (uintptr_t)&__heap_start - RAMSTART;
+}
+
+uint16_t RamHeap() {
+  return __brkval == NULL ? 0 : __brkval - &__heap_start;
+}
+
+// The most of the RAM ever in use: static, heap and the deepest stack.
+uint16_t RamPeak() {
+  uint8_t* p = (uint8_t*)(__brkval == NULL ? &__heap_start : __brkval);
+  uint16_t untouched = 0;
+  while (p <= (uint8_t*)RAMEND && *p == kRamPaint) {
+    p++;
+    untouched++;
+  }
+  return RAMEND + 1 - RAMSTART - untouched;
+}
+
+/*****************************************************************************/
+// Output.
+
+uint8_t overBudget = 0;
+
+void ConsoleWrite(const char* s) {
+  while (*s) {
+    GPIOR0 = *s++;
+  }
+}
+
+void ConsoleWriteNumber(uint32_t n) {
+  char buf[11];
+  char* p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  do {
+    *--p = '0' + (n % 10);
+    n /= 10;
+  } while (n > 0);
+  ConsoleWrite(p);
+}
+
+void Report(const char* name, uint32_t value) {
+  ConsoleWrite("BENCH ");
+  ConsoleWrite(name);
+  ConsoleWrite(" ");
+  ConsoleWriteNumber(value);
+  ConsoleWrite("\n");
+}
+
+void ReportWithin(const char* name, uint32_t value, uint32_t limit) {
+  Report(name, value);
+  if (value > limit) {
+    ConsoleWrite("BENCH over-budget/");
+    ConsoleWrite(name);
+    ConsoleWrite(" ");
+    ConsoleWriteNumber(limit);
+    ConsoleWrite("\n");
+    overBudget++;
+  }
+}
+
+// simavr exits when the core sleeps with interrupts off.
+void Finish() {
+  ConsoleWrite("BENCH done ");
+  ConsoleWriteNumber(overBudget);
+  ConsoleWrite("\n");
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_mode();
+}
+
+#endif  // AVR_BENCH_CYCLE_COUNTER_H
@@ -0,0 +1,85 @@
+// SPI timings of the LPD8806 driver from tube-teensylc, run under simavr
+// on the ATmega328p only (the ATtiny85 has no SPI port).  See the
+// Makefile.
+//
+// Reports how long show() blocks, how long the whole frame takes on the
+// wire, and how much of the CPU the transmit interrupt takes while the
+// frame goes out.  The bit-banged path is timed too, for comparison.
+
+#include <stdint.h>
+
+#include "avr_mcu_section.h"
+
+#include "../tube-teensylc/lpd8806_spi.h"
+#include "cycle_counter.h"
+
+AVR_MCU(F_CPU, BENCH_MCU);
+AVR_MCU_SIMAVR_CONSOLE(&GPIOR0);
+
+// Same shape as tube-teensylc: 22 pixels sent to 8 strands.
+#define kPixels 22
+#define kCopies 8
+#define kWireBytes (kPixels * 3 * kCopies + (kPixels * kCopies + 31) / 32)
+
+// Short enough to fit inside one frame at the default clock divider.
+#define kWorkReps 2000
+
+volatile uint8_t sink;
+
+void Work() {
+  for (uint16_t i = 0; i < kWorkReps; i++) {
+    sink = sink + i;
+  }
+}
+
+uint32_t TimeWork() {
+  uint32_t start = Cycles();
+  Work();
+  return Cycles() - start;
+}
+
+void Fill(Lpd8806Spi* strip) {
+  for (uint16_t i = 0; i < strip->numPixels(); i++) {
+    strip->setPixelColor(i, i, 255 - i, i * 3);
+  }
+}
+
+int main() {
+  StartCounter();
+
+  Lpd8806Spi spi(kPixels, kCopies, MOSI, SCK);
+  spi.begin();
+  Fill(&spi);
+
+  uint32_t start = Cycles();
+  spi.show();
+  uint32_t call = Cycles() - start;
+  spi.waitForShow();
+  uint32_t frame = Cycles() - start;
+  Report("Lpd8806Spi::show/call", call);
+  Report("Lpd8806Spi/frame", frame);
+  Report("Lpd8806Spi/byte", frame / kWireBytes);
+
+  // The same work with and without a frame going out; the difference is
+  // what the interrupt took.
+  uint32_t idle = TimeWork();
+  spi.show();
+  uint32_t busy = TimeWork();
+  bool overran = !spi.busy();
+  spi.waitForShow();
+  Report("Lpd8806Spi/isr-load-permille", 1000 - 1000 * idle / busy);
+  if (overran) {
+    // The frame ended before the work did, so the load is understated.
+    Report("Lpd8806Spi/isr-load-overran", 1);
+  }
+
+  Lpd8806Spi bitbang(kPixels, kCopies, 2, 3);
+  bitbang.begin();
+  Fill(&bitbang);
+  start = Cycles();
+  bitbang.show();
+  Report("Lpd8806Spi-bitbang/frame", Cycles() - start);
+
+  Finish();
+  return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef AVR_BENCH_ARDUINO_H
+#define AVR_BENCH_ARDUINO_H
+
+// Just enough of the Arduino core for the sketches to link on bare
+// avr-libc.  Nothing here is timed.
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+
+inline void delay(unsigned long) {}
+inline unsigned long millis() { return 0; }
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+#define OUTPUT 1
+#define INPUT 0
+#define HIGH 1
+#define LOW 0
+
+#if defined(__AVR_ATmega328P__)
+// Uno pin mapping: 0-7 are PORTD, 8-13 are PORTB.
+static const uint8_t SS = 10;
+static const uint8_t MOSI = 11;
+static const uint8_t MISO = 12;
+static const uint8_t SCK = 13;
+
+#define digitalPinToPort(pin) ((pin) < 8 ? 0 : 1)
+#define digitalPinToBitMask(pin) (_BV((pin) < 8 ? (pin) : (pin) - 8))
+#define portOutputRegister(port) ((port) == 0 ? &PORTD : &PORTB)
+#define portModeRegister(port) ((port) == 0 ? &DDRD : &DDRB)
+#else
+// ATtiny85: every pin is on PORTB.
+#define digitalPinToPort(pin) 0
+#define digitalPinToBitMask(pin) (_BV(pin))
+#define portOutputRegister(port) (&PORTB)
+#define portModeRegister(port) (&DDRB)
+#endif
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+  volatile uint8_t* ddr = portModeRegister(digitalPinToPort(pin));
+  if (mode == OUTPUT) {
+    *ddr |= digitalPinToBitMask(pin);
+  } else {
+    *ddr &= ~digitalPinToBitMask(pin);
+  }
+}
+
+inline void* operator new(size_t size) { return malloc(size); }
+inline void* operator new[](size_t size) { return malloc(size); }
+inline void operator delete(void* p) { free(p); }
+inline void operator delete[](void* p) { free(p); }
+inline void operator delete(void* p, size_t) { free(p); }
+inline void operator delete[](void* p, size_t) { free(p); }
+extern "C" void __cxa_pure_virtual() { abort(); }
+
+#endif  // AVR_BENCH_ARDUINO_H
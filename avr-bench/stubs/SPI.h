@@ -0,0 +1,62 @@
+#ifndef AVR_BENCH_SPI_H
+#define AVR_BENCH_SPI_H
+
+// The AVR parts of the Arduino SPI library, driving the real registers so
+// simavr clocks bytes out with true timing.
+
+#include "Arduino.h"
+
+#ifdef SPDR
+
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV16 0x01
+#define SPI_CLOCK_DIV64 0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV32 0x06
+
+#define SPI_MODE0 0x00
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+class SPIClass {
+public:
+  void begin() {
+    pinMode(SS, OUTPUT);
+    pinMode(MOSI, OUTPUT);
+    pinMode(SCK, OUTPUT);
+    SPCR |= _BV(MSTR) | _BV(SPE);
+  };
+
+  void setBitOrder(uint8_t order) {
+    if (order == LSBFIRST) {
+      SPCR |= _BV(DORD);
+    } else {
+      SPCR &= ~_BV(DORD);
+    }
+  };
+
+  void setDataMode(uint8_t mode) {
+    SPCR = (SPCR & ~0x0c) | mode;
+  };
+
+  void setClockDivider(uint8_t rate) {
+    SPCR = (SPCR & ~0x03) | (rate & 0x03);
+    SPSR = (SPSR & ~0x01) | ((rate >> 2) & 0x01);
+  };
+
+  uint8_t transfer(uint8_t data) {
+    SPDR = data;
+    while (!(SPSR & _BV(SPIF))) {
+    }
+    return SPDR;
+  };
+};
+
+SPIClass SPI;
+
+#endif  // SPDR
+
+#endif  // AVR_BENCH_SPI_H
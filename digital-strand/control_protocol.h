@@ -0,0 +1,178 @@
+#ifndef CONTROL_PROTOCOL_H
+#define CONTROL_PROTOCOL_H
+
+// Binary protocol for changing the sketch's settings over the serial port
+// while it runs; shared by the sketch and tools/strandctl.
+//
+// Every message, both ways, is
+//   kControlSync, command, length, payload[length], checksum
+// where the checksum makes the 8-bit sum of command, length, payload and
+// checksum come to zero.  Replies carry the command with kControlReply
+// set, and a status byte first in the payload.  Numbers are little
+// endian.
+//
+//   kCmdSetParam     param, value (u16)      -> status
+//   kCmdSetSequence  index                   -> status
+//   kCmdGetStats                             -> status, stats (see the
+//                                               sketch's SendStats())
+//   kCmdPing         anything                -> status, the same bytes
+//   kCmdSync         leader's time (see      no reply; many boards share
+//                    sync_clock.h)           the leader's line
+//
+// Replies to the set commands wait for the first frame shown with the new
+// setting, so the time to the reply is the time to a visible change.
+//
+// ControlParser takes one byte at a time and never blocks, so the sketch
+// can feed it a few bytes per loop() and keep its frame timing.  Bytes
+// that don't make a valid message are dropped, and it resynchronizes on
+// the next kControlSync.
+
+#include <stdint.h>
+
+#define kControlSync 0xa5
+#define kControlReply 0x80
+// Enough for a stats reply with every task the sketch can run.
+#define kControlMaxPayload 72
+#define kControlMaxMessage (kControlMaxPayload + 4)
+
+enum ControlCommand {
+  kCmdSetParam = 1,
+  kCmdSetSequence = 2,
+  kCmdGetStats = 3,
+  kCmdPing = 4,
+  kCmdSync = 5,
+};
+
+enum ControlParam {
+  kParamSteps = 0,     // Fade steps, k_numSteps.
+  kParamInterval = 1,  // Milliseconds per pixel step, strip_interval.
+  kParamScale = 2,     // Color scale, kStripScale.
+};
+
+enum ControlStatus {
+  kStatusOk = 0,
+  kStatusBadCommand = 1,
+  kStatusBadValue = 2,
+  kStatusNoMemory = 3,  // Valid, but the board hasn't the RAM for it.
+};
+
+inline uint16_t ControlGetU16(const uint8_t* p) {
+  return p[0] | p[1] << 8;
+}
+
+inline uint32_t ControlGetU32(const uint8_t* p) {
+  return p[0] | p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+inline uint8_t* ControlPutU16(uint8_t* p, uint16_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  return p;
+}
+
+inline uint8_t* ControlPutU32(uint8_t* p, uint32_t value) {
+  p = ControlPutU16(p, value);
+  return ControlPutU16(p, value >> 16);
+}
+
+// Writes the message into `out`, which needs length + 4 bytes, and
+// returns its size.
+inline uint8_t ControlFrame(uint8_t command, const uint8_t* payload,
+                            uint8_t length, uint8_t* out) {
+  uint8_t sum = command + length;
+  out[0] = kControlSync;
+  out[1] = command;
+  out[2] = length;
+  for (uint8_t i = 0; i < length; i++) {
+    out[3 + i] = payload[i];
+    sum += payload[i];
+  }
+  out[3 + length] = -sum;
+  return length + 4;
+}
+
+class ControlParser {
+public:
+  ControlParser():
+    state_(kWaitSync), command_(0), length_(0), received_(0), sum_(0),
+    errors_(0) {};
+
+  // Returns true when `byte` completes a valid message, which stays in
+  // command(), length() and payload() until the next call.
+  bool Feed(uint8_t byte) {
+    switch (state_) {
+    case kWaitSync:
+      if (byte == kControlSync) {
+        state_ = kWaitCommand;
+      }
+      return false;
+    case kWaitCommand:
+      command_ = byte;
+      sum_ = byte;
+      state_ = kWaitLength;
+      return false;
+    case kWaitLength:
+      if (byte > kControlMaxPayload) {
+        errors_++;
+        state_ = byte == kControlSync ? kWaitCommand : kWaitSync;
+        return false;
+      }
+      length_ = byte;
+      received_ = 0;
+      sum_ += byte;
+      state_ = length_ > 0 ? kPayload : kChecksum;
+      return false;
+    case kPayload:
+      payload_[received_++] = byte;
+      sum_ += byte;
+      if (received_ == length_) {
+        state_ = kChecksum;
+      }
+      return false;
+    case kChecksum:
+      state_ = kWaitSync;
+      if ((uint8_t)(sum_ + byte) != 0) {
+        errors_++;
+        return false;
+      }
+      return true;
+    }
+    return false;
+  };
+
+  uint8_t command() {
+    return command_;
+  };
+
+  uint8_t length() {
+    return length_;
+  };
+
+  const uint8_t* payload() {
+    return payload_;
+  };
+
+  // Messages dropped for a bad length or checksum.
+  uint16_t errors() {
+    return errors_;
+  };
+
+private:
+  enum State {
+    kWaitSync,
+    kWaitCommand,
+    kWaitLength,
+    kPayload,
+    kChecksum,
+  };
+
+  State state_;
+  uint8_t command_;
+  uint8_t length_;
+  uint8_t received_;
+  uint8_t sum_;
+  uint16_t errors_;
+  uint8_t payload_[kControlMaxPayload];
+};
+
+#endif  // CONTROL_PROTOCOL_H
@@ -1,17 +1,30 @@
 #ifdef ARDUINO
 #  include "LPD8806.h"
 #  include "SPI.h" // Comment out this line if using Trinket or Gemma
+#  include <avr/eeprom.h>
 #  ifdef __AVR_ATtiny85__
 #    include <avr/power.h>
 #  endif
 #else
+#  include <fcntl.h>
+#  include <stdio.h>
+#  include <stdlib.h>
+#  include <string.h>
+#  include <termios.h>
 #  include <unistd.h>
 #  include <curses.h>
 #  include <iostream>
+#  include "eeprom_file.h"
+#  include "frame_pacer.h"
 #endif
 
 #include <stdint.h>
 
+#include "control_protocol.h"
+#include "state_store.h"
+#include "sync_clock.h"
+#include "timer_wheel.h"
+
 typedef uint8_t byte;
 
 // Example to control LPD8806-based RGB LED Modules in a strip
@@ -32,6 +45,11 @@ typedef uint8_t byte;
 // Scale applied to colors.
 const unsigned int kStripScale = 1;
 
+// The two above as they are now; both can be changed over the serial
+// port (see control_protocol.h).
+byte numSteps = k_numSteps;
+byte stripScale = kStripScale;
+
 // Chose 2 pins for output; can be any valid output pins:
 int dataPin  = 2;
 int clockPin = 3;
@@ -54,7 +72,7 @@ byte MoveToTarget(byte current, byte target, byte step) {
 }
 
 byte SetStep(byte target, byte last) {
-  byte step = (target - last) / k_numSteps;
+  byte step = (target - last) / numSteps;
   if (step == 0) {
     if (target > last) {
       step = 1;
@@ -86,6 +104,10 @@ public:
     return colors_[index % max_colors_];
   };
 
+  byte size() {
+    return max_colors_;
+  };
+
 protected:
   void AddColor(ColorTuple color) {
     if (max_colors_ < 10) {
@@ -228,13 +250,138 @@ private:
 };
 
 
+// Every color Color::StepColor() goes through on a full trip around
+// `sequence`, one entry per step, so that a pixel's whole fade state is
+// its position (phase) in here.  Rebuilt by Build() only when the sequence
+// changes.
+//
+// Each fade takes under 2 * numSteps steps, so a trip round a sequence of
+// n colors fits in n * 2 * numSteps entries.  The table is only ever
+// allocated by Reserve(), which setup() and a change of numSteps call
+// first; Build() then fits the trip into whatever room there is.  Trips
+// longer than the table (or kGradientMaxSize) keep every n-th step, so
+// the fades run n times faster.  If the first Reserve() finds no RAM the
+// gradient falls back to kGradientFallbackSize built-in entries, so the
+// strip still runs, with coarse fades.
+#define kGradientMaxSize 256
+#define kGradientFallbackSize 16
+
+class Gradient {
+public:
+  Gradient():
+    colors_(NULL), capacity_(0), length_(0), colors_in_seq_(0) {};
+
+  // Makes room for `entries` colors (at most kGradientMaxSize).  Returns
+  // false, leaving the table as it was (or the fallback, if there was
+  // none), when there isn't the RAM.
+  bool Reserve(uint16_t entries) {
+    if (entries > kGradientMaxSize) {
+      entries = kGradientMaxSize;
+    }
+    if (entries <= capacity_) {
+      return true;
+    }
+    ColorTuple* colors = (ColorTuple*)malloc(entries * sizeof(ColorTuple));
+    if (colors == NULL) {
+      if (colors_ == NULL) {
+        colors_ = fallback_;
+        capacity_ = kGradientFallbackSize;
+      }
+      return false;
+    }
+    for (uint16_t i = 0; i < length_; i++) {
+      colors[i] = colors_[i];
+    }
+    if (colors_ != fallback_) {
+      free(colors_);
+    }
+    colors_ = colors;
+    capacity_ = entries;
+    return true;
+  };
+
+  // Rebuilds the table for `sequence`; Reserve() must have been called,
+  // whether or not it got the RAM.
+  void Build() {
+    // Walk the fades once to find the length, then again to record them.
+    uint16_t steps = Walk(1, false);
+    uint16_t stride = (steps + capacity_ - 1) / capacity_;
+    length_ = (steps + stride - 1) / stride;
+    colors_in_seq_ = sequence.size();
+    Walk(stride, true);
+  };
+
+  // Phase at which the fade out of sequence color `index` starts.
+  byte Start(uint32_t index) {
+    return starts_[index % colors_in_seq_];
+  };
+
+  // Index of the sequence color whose fade `phase` is in.
+  byte Fade(byte phase) {
+    byte fade = colors_in_seq_ - 1;
+    while (fade > 0 && starts_[fade] > phase) {
+      fade--;
+    }
+    return fade;
+  };
+
+  byte Next(byte phase) {
+    return phase + 1 == length_ ? 0 : phase + 1;
+  };
+
+  // Next() `steps` times over.
+  byte Advance(byte phase, uint32_t steps) {
+    return (phase + steps % length_) % length_;
+  };
+
+  ColorTuple At(byte phase) {
+    return colors_[phase];
+  };
+
+private:
+  // Steps a Color around the sequence, keeping every stride-th color.
+  // Returns the number of steps in the trip.
+  uint16_t Walk(uint16_t stride, bool record) {
+    Color color(sequence.GetNextColor(0));
+    color.SetTarget(1);
+    uint16_t step = 0;
+    for (byte fade = 0; fade < sequence.size(); fade++) {
+      ColorTuple target = sequence.GetNextColor(fade + 1);
+      if (record) {
+        starts_[fade] = step / stride;
+      }
+      do {
+        if (record && step % stride == 0) {
+          colors_[step / stride] = ColorTuple(color.GetRed(),
+                                              color.GetGreen(),
+                                              color.GetBlue());
+        }
+        color.StepColor();
+        step++;
+      } while (color.GetRed() != target.red_
+               || color.GetGreen() != target.green_
+               || color.GetBlue() != target.blue_);
+    }
+    return step;
+  };
+
+  ColorTuple* colors_;
+  uint16_t capacity_;
+  uint16_t length_;
+  byte starts_[10];
+  byte colors_in_seq_;
+  ColorTuple fallback_[kGradientFallbackSize];
+};
+
+Gradient gradient;
+
 class Strip {
 public:
+  // `gradient` must already be built.
   Strip(byte size):
   size_(size) {
     for (int i = 0; i < size; i++) {
-      pixels_[i] = Color(sequence.GetNextColor(i));
-      pixels_[i].SetTarget(i + 1);
+      phases_[i] = gradient.Start(i);
     }
   };
 
@@ -242,21 +389,56 @@ public:
     return size_;
   };
 
-  void setPixelColor(const byte& pixel, const class Color& color) {
-    pixels_[pixel] = color;
-  };
-
   void StepColor(const byte& pixel) {
-    pixels_[pixel].StepColor();
+    phases_[pixel] = gradient.Next(phases_[pixel]);
+  }
+
+  void StepColor(byte pixel, uint32_t steps) {
+    phases_[pixel] = gradient.Advance(phases_[pixel], steps);
   }
 
+  // Back to how the constructor left the pixels.
+  void Restart() {
+    for (int i = 0; i < size_; i++) {
+      phases_[i] = gradient.Start(i);
+    }
+  };
+
+  // Call after changing `sequence`.  Each pixel starts over at the
+  // beginning of the fade it was in, with the new colors.
+  void SequenceChanged() {
+    for (int i = 0; i < size_; i++) {
+      phases_[i] = gradient.Fade(phases_[i]);
+    }
+    gradient.Build();
+    for (int i = 0; i < size_; i++) {
+      phases_[i] = gradient.Start(phases_[i]);
+    }
+  };
 
   virtual void begin() = 0;
   virtual void show() = 0;
 
 protected:
+  ColorTuple PixelColor(byte pixel) {
+    ColorTuple color = gradient.At(phases_[pixel]);
+    if (stripScale != 1) {
+      color = ColorTuple(Scaled(color.red_), Scaled(color.green_),
+                         Scaled(color.blue_));
+    }
+    return color;
+  };
+
+  // The LPD8806 takes 7 bits a channel, so a scaled channel stops at 127
+  // rather than spilling into the high bit (or past a byte) and going
+  // dark.
+  static byte Scaled(byte channel) {
+    unsigned int scaled = channel * stripScale;
+    return scaled > 127 ? 127 : scaled;
+  };
+
   byte size_;
-  class Color pixels_[nLEDS];
+  byte phases_[nLEDS];
 
 };
 
@@ -281,10 +463,11 @@ public:
 
 private:
   void SetPixelColor(short pixel) {
+    ColorTuple color = PixelColor(pixel);
     for (int i = 0; i < nSTRIPS; i++) {
-      byte red = pixels_[pixel].GetRed() * kStripScale;
-      byte blue = pixels_[pixel].GetBlue() * kStripScale;
-      byte green = pixels_[pixel].GetGreen() * kStripScale;
+      byte red = color.red_;
+      byte blue = color.blue_;
+      byte green = color.green_;
 
       if (kSwapBlueGreen) {
         strip_.setPixelColor(pixel + (nLEDS * i),
@@ -306,6 +489,9 @@ private:
 
 #else
 
+// Stands in for the board's clock; see main().
+FramePacer pacer;
+
 class NcursesStrip: public Strip {
 public:
   NcursesStrip(byte size):
@@ -320,14 +506,16 @@ public:
       
     }
     wrefresh(stdscr);
+    pacer.FrameShown();
   };
 private:
   void SetPixelColor(short pixel) {
     unsigned int pair = pixel + 32; // static offset.
     
-    byte red = pixels_[pixel].GetRed();
-    byte green = pixels_[pixel].GetGreen();
-    byte blue = pixels_[pixel].GetBlue();
+    ColorTuple color = PixelColor(pixel);
+    byte red = color.red_;
+    byte green = color.green_;
+    byte blue = color.blue_;
     
     // Create colors starting at 32 (== pair):
     init_color(pair, red * 10, green * 10, blue * 10);
@@ -339,25 +527,56 @@ private:
     mvwaddch(stdscr, 5, 10 + pixel, '#' | COLOR_PAIR(pair));
   };
 };
+
+// Writes every shown frame as raw r, g, b bytes, for
+// dstrand-waterfall/tools/bake-animation.
+class FrameDumpStrip: public Strip {
+public:
+  FrameDumpStrip(byte size, FILE* out):
+    Strip(size), out_(out)
+  {};
+
+  virtual void begin() {};
+
+  virtual void show() {
+    for (unsigned int i = 0; i < size_; i++) {
+      ColorTuple color = PixelColor(i);
+      byte rgb[3] = {color.red_, color.green_, color.blue_};
+      fwrite(rgb, 1, sizeof(rgb), out_);
+    }
+    pacer.FrameShown();
+  };
+
+private:
+  FILE* out_;
+};
+
+// Set by -r; when non-NULL frames go there instead of the terminal.
+FILE* frameDump = NULL;
 #endif
 
 Strip *mystrip = NULL;
 
-// Variables will change:
-unsigned long previousMillis = 0;        // will store last time LED was updated
+// Everything loop() does, each at its own rate.
+TimerWheel scheduler;
 
-// the follow variables is a long because the time, measured in miliseconds,
-// will quickly become a bigger number than can be stored in an int.
+// The status LED blinks at `interval`, which shrinks by interval_factor
+// each blink down to min_interval and then grows back to max_interval.
 long interval = 1000;           // interval at which to blink (milliseconds)
 
 long min_interval = 50;
 long max_interval = 1000;
 bool interval_decreasing = true;
 long interval_factor = 2;
+uint8_t strip_task = kNoTask;
+uint8_t status_task = kNoTask;
+#if defined(ARDUINO) && !defined(LED_BUILTIN)
+#  define LED_BUILTIN 13
+#endif
+bool status_on = false;
 
 // State for the strip:
-unsigned long strip_interval = 1; // Time between LED activations.
-unsigned long strip_last_change_millis = 0;
+unsigned long strip_interval = 2; // Time between LED activations.
 uint32_t pixel = 0; // Pixel to act on.
 
 Color color(0, 0, 0); // Active color.
@@ -372,6 +591,9 @@ Strip* CreateStrip(byte num_leds) {
 # ifdef ARDUINO
   return new ArduinoStrip(num_leds);
 # else
+  if (frameDump != NULL) {
+    return new FrameDumpStrip(num_leds, frameDump);
+  }
   return new NcursesStrip(num_leds);
 # endif
 }
@@ -379,62 +601,599 @@ Strip* CreateStrip(byte num_leds) {
 ColorSeq color_seq_seq[3] = {RainbowSeq(), RedSeq(), BlueSeq()};
 const uint32_t kIterationThreshold = 10000;
 const byte kColorSeqLen = 3;
+
+// Gradient entries that hold a trip round any of the sequences at `steps`.
+uint16_t GradientEntries(byte steps) {
+  byte colors = 0;
+  for (byte i = 0; i < kColorSeqLen; i++) {
+    if (color_seq_seq[i].size() > colors) {
+      colors = color_seq_seq[i].size();
+    }
+  }
+  return (uint16_t)colors * 2 * steps;
+}
+byte sequence_index = 0;
 uint32_t iterations = 0;
 
+/*****************************************************************************/
+// Shared time, for boards that show one piece together.  Build the board
+// that leads with -DSYNC_LEADER (-L on the host); it sends kCmdSync on its
+// serial port every kSyncPeriodMs, and boards listening on that line steer
+// their clocks to it (see sync_clock.h).  The strip's frame number comes
+// from the synced clock, so boards that agree on the time show the same
+// frame.  On its own a board's synced clock is just its own.
+//
+// The synced time is always frame x frame length, so changing the length
+// moves the clock to the start of the current frame at the new length
+// (SetFrameInterval()) rather than jumping the frame number.
+
+#define kSyncPeriodMs 250
+
+SyncClock syncClock;
+#ifdef SYNC_LEADER
+bool syncLeader = true;
+#else
+bool syncLeader = false;
+#endif
+uint8_t sync_task = kNoTask;
+
+// Frames shown since the synced clock's zero.
+uint32_t frame = 0;
+
+/*****************************************************************************/
+// Snapshots of where the animation is, every kStateSavePeriodMs, so
+// setup() can pick up from the last one; see state_store.h.  The host
+// keeps them in the file given by -E.
+
+#define kStateSavePeriodMs 60000UL
+
+#ifdef ARDUINO
+class BoardEeprom {
+public:
+  bool Ready() {
+    return eeprom_is_ready();
+  };
+
+  uint8_t Read(uint16_t address) {
+    return eeprom_read_byte((const uint8_t*)address);
+  };
+
+  // Returns once the write has started.
+  void Write(uint16_t address, uint8_t value) {
+    eeprom_write_byte((uint8_t*)address, value);
+  };
+};
+
+BoardEeprom eeprom;
+StateStore<BoardEeprom> stateStore(&eeprom);
+#else
+EepromFile eeprom;
+StateStore<EepromFile> stateStore(&eeprom);
+#endif
+uint8_t state_task = kNoTask;
+
+#ifndef ARDUINO
+long millis() {
+  return pacer.Micros() / 1000;
+}
+
+unsigned long micros() {
+  return pacer.Micros();
+}
+#endif
+
+unsigned long SyncedMillis() {
+  return syncClock.Micros(micros()) / 1000;
+}
+
+// The frame the synced clock is in.  Kept to 32 bits like `frame`, so
+// both wrap together.
+uint32_t SyncedFrame() {
+  return syncClock.Micros(micros()) / (strip_interval * 1000UL);
+}
+
+// Changes the frame length, keeping the frame number.
+void SetFrameInterval(uint16_t value) {
+  strip_interval = value;
+  scheduler.SetPeriod(strip_task, value);
+  syncClock.Set((uint64_t)frame * value * 1000, micros());
+}
+
+/*****************************************************************************/
+// Serial control; see control_protocol.h.  The Trinket has no serial
+// port, and the host uses a pty given by -p.
+
+#if !defined(ARDUINO) || !defined(__AVR_ATtiny85__)
+#  define CONTROL_PORT 1
+#endif
+
+// Bytes parsed per loop(), at most; enough for any command, and small
+// enough not to hold up a frame.
+#define kControlBudget 16
+
+#ifdef CONTROL_PORT
+ControlParser control;
+
+// The set command waiting for its change to be shown.
+bool ack_pending = false;
+uint8_t ack_command = 0;
+
+#  ifdef ARDUINO
+int ControlRead() {
+  return Serial.available() > 0 ? Serial.read() : -1;
+}
+
+void ControlWrite(const uint8_t* data, uint8_t size) {
+  Serial.write(data, size);
+}
+#  else
+// Set by -p.
+int controlFd = -1;
+
+int ControlRead() {
+  uint8_t value;
+  if (controlFd < 0 || read(controlFd, &value, 1) != 1) {
+    return -1;
+  }
+  return value;
+}
+
+void ControlWrite(const uint8_t* data, uint8_t size) {
+  if (write(controlFd, data, size) != size) {
+    // The client went away; the next one will ask again.
+  }
+}
+#  endif
+
+void Reply(uint8_t command, uint8_t status, const uint8_t* data,
+           uint8_t size) {
+  uint8_t payload[kControlMaxPayload];
+  uint8_t message[kControlMaxMessage];
+  payload[0] = status;
+  for (uint8_t i = 0; i < size && i + 1 < kControlMaxPayload; i++) {
+    payload[i + 1] = data[i];
+  }
+  uint8_t length = size + 1 < kControlMaxPayload ? size + 1
+                                                 : kControlMaxPayload;
+  ControlWrite(message, ControlFrame(command | kControlReply, payload,
+                                     length, message));
+}
+
+// Called after every show().
+void AckShown() {
+  if (ack_pending) {
+    ack_pending = false;
+    Reply(ack_command, kStatusOk, NULL, 0);
+  }
+}
+
+uint8_t SetParam(uint8_t param, uint16_t value) {
+  switch (param) {
+  case kParamSteps:
+    if (value < 1 || value > 64) {
+      return kStatusBadValue;
+    }
+    if (!gradient.Reserve(GradientEntries(value))) {
+      return kStatusNoMemory;
+    }
+    numSteps = value;
+    // The fades are baked into the gradient.
+    mystrip->SequenceChanged();
+    return kStatusOk;
+  case kParamInterval:
+    if (value < 1 || value > 10000) {
+      return kStatusBadValue;
+    }
+    SetFrameInterval(value);
+    return kStatusOk;
+  case kParamScale:
+    if (value < 1 || value > 4) {
+      return kStatusBadValue;
+    }
+    stripScale = value;
+    return kStatusOk;
+  }
+  return kStatusBadValue;
+}
+
+// status, iterations (u32), steps, interval (u16), scale, sequence,
+// parse errors (u16), task count, then per task runs, late and overruns
+// (u32) and worst lateness in ms (u16).
+#define kStatsSize (12 + 14 * kWheelMaxTasks)
+#if kStatsSize + 1 > kControlMaxPayload
+#  error "a stats reply doesn't fit in kControlMaxPayload"
+#endif
+
+void SendStats() {
+  uint8_t stats[kStatsSize];
+  uint8_t* p = ControlPutU32(stats, iterations);
+  *p++ = numSteps;
+  p = ControlPutU16(p, strip_interval);
+  *p++ = stripScale;
+  *p++ = sequence_index;
+  p = ControlPutU16(p, control.errors());
+  *p++ = scheduler.count();
+  for (uint8_t id = 0; id < scheduler.count(); id++) {
+    const TaskStats& task = scheduler.Stats(id);
+    p = ControlPutU32(p, task.runs);
+    p = ControlPutU32(p, task.late);
+    p = ControlPutU32(p, task.overruns);
+    p = ControlPutU16(p, task.worst_late);
+  }
+  Reply(kCmdGetStats, kStatusOk, stats, p - stats);
+}
+
+void HandleCommand() {
+  uint8_t command = control.command();
+  const uint8_t* payload = control.payload();
+  uint8_t length = control.length();
+  uint8_t status;
+  switch (command) {
+  case kCmdSetParam:
+    status = length == 3 ? SetParam(payload[0], ControlGetU16(payload + 1))
+                         : kStatusBadValue;
+    break;
+  case kCmdSetSequence:
+    if (length != 1 || payload[0] >= kColorSeqLen) {
+      status = kStatusBadValue;
+      break;
+    }
+    sequence_index = payload[0];
+    sequence = color_seq_seq[sequence_index];
+    mystrip->SequenceChanged();
+    status = kStatusOk;
+    break;
+  case kCmdGetStats:
+    SendStats();
+    return;
+  case kCmdPing:
+    Reply(command, kStatusOk, payload, length);
+    return;
+  case kCmdSync:
+    // Followers take the leader's frame length too, so the frame numbers
+    // mean the same everywhere.
+    if (!syncLeader && length == kSyncPayload) {
+      if (SyncInterval(payload) != strip_interval
+          && SyncInterval(payload) > 0) {
+        SetFrameInterval(SyncInterval(payload));
+      }
+      syncClock.Update(SyncTime(payload), micros());
+    }
+    return;
+  default:
+    Reply(command, kStatusBadCommand, NULL, 0);
+    return;
+  }
+  if (status != kStatusOk) {
+    Reply(command, status, NULL, 0);
+    return;
+  }
+  // Both changes go out with the next frame.
+  AckShown();
+  ack_pending = true;
+  ack_command = command;
+}
+
+void ServiceControl() {
+  for (byte budget = kControlBudget; budget > 0; budget--) {
+    int next = ControlRead();
+    if (next < 0) {
+      return;
+    }
+    if (control.Feed(next)) {
+      HandleCommand();
+    }
+  }
+}
+
+void SendSync() {
+  uint8_t payload[kSyncPayload];
+  uint8_t message[kSyncPayload + 4];
+  SyncPack(syncClock.Micros(micros()), strip_interval, payload);
+  ControlWrite(message, ControlFrame(kCmdSync, payload, kSyncPayload,
+                                     message));
+}
+#else
+void AckShown() {}
+
+void ServiceControl() {}
+#endif
+
+// Every kIterationThreshold passes over the strip, before the first step
+// of the next pass, so the frame that finishes a pass still shows the old
+// colors.
+#define kSequenceFrames (kIterationThreshold * nLEDS)
+
+void SwitchSequence() {
+  sequence_index = (iterations / kIterationThreshold) % kColorSeqLen;
+  sequence = color_seq_seq[sequence_index];
+  mystrip->SequenceChanged();
+}
+
+// Steps the next pixel: one frame.
+void AdvanceFrame() {
+  if (frame > 0 && frame % kSequenceFrames == 0) {
+    SwitchSequence();
+  }
+  mystrip->StepColor(pixel);
+  frame++;
+  pixel += 1;
+  if (pixel == mystrip->numPixels()) {
+    pixel = 0;
+    iterations += 1;
+  }
+}
+
+// How many of frames 1..`frames` step `pixel`.
+uint32_t StepsBy(byte pixel, uint32_t frames) {
+  return (frames + nLEDS - 1 - pixel) / nLEDS;
+}
+
+// Puts the strip straight into the state `target` frames from the start,
+// as AdvanceFrame() would have left it, without going through every
+// frame: each pixel moves through the gradient by the number of times it
+// would have been stepped, a sequence at a time.
+void SeekFrame(uint32_t target) {
+  sequence_index = 0;
+  sequence = color_seq_seq[0];
+  gradient.Build();
+  mystrip->Restart();
+  uint32_t at = 0;
+  for (;;) {
+    uint32_t end = target - at > kSequenceFrames ? at + kSequenceFrames
+                                                 : target;
+    for (byte i = 0; i < nLEDS; i++) {
+      mystrip->StepColor(i, StepsBy(i, end) - StepsBy(i, at));
+    }
+    at = end;
+    iterations = at / nLEDS;
+    if (at == target) {
+      break;
+    }
+    SwitchSequence();
+  }
+  frame = target;
+  pixel = target % nLEDS;
+}
+
+void SaveState() {
+  AnimationState state;
+  state.frame = frame;
+  state.sequence_index = sequence_index;
+  state.steps = numSteps;
+  state.scale = stripScale;
+  state.interval = strip_interval;
+  stateStore.Save(state);
+}
+
+// Called from setup(), after the strip is made and before it's first
+// shown.  Seeks to the saved frame, so the pixels come back as they were
+// rather than black, and moves the clock to it, so the strip goes on
+// from there.  A leader's time will override the clock.
+void RestoreState() {
+  AnimationState state;
+  if (!stateStore.Load(&state) || state.sequence_index >= kColorSeqLen
+      || state.steps < 1 || state.steps > 64 || state.scale < 1
+      || state.scale > 4 || state.interval < 1 || state.interval > 10000) {
+    return;
+  }
+  if (!gradient.Reserve(GradientEntries(state.steps))) {
+    return;
+  }
+  numSteps = state.steps;
+  stripScale = state.scale;
+  strip_interval = state.interval;
+  SeekFrame(state.frame);
+  // Changed over the serial port since the last switch.
+  if (state.sequence_index != sequence_index) {
+    sequence_index = state.sequence_index;
+    sequence = color_seq_seq[sequence_index];
+    mystrip->SequenceChanged();
+  }
+  syncClock.Set((uint64_t)state.frame * strip_interval * 1000, micros());
+}
+
+// Shows the frame the synced clock is at.  On time that's the next one;
+// after a late run or a clock correction it catches up, and after a jump
+// it seeks.  If the clock was pulled back it waits for it.
+void StepStrip() {
+  uint32_t target = SyncedFrame();
+  // Both wrap after 2^32 frames.
+  int32_t ahead = target - frame;
+  if (ahead <= 0) {
+    return;
+  }
+  if (ahead > nLEDS) {
+    SeekFrame(target);
+  } else {
+    while (frame != target) {
+      AdvanceFrame();
+    }
+  }
+  mystrip->show();
+  AckShown();
+}
+
+void BlinkStatus() {
+  status_on = !status_on;
+#ifdef ARDUINO
+  digitalWrite(LED_BUILTIN, status_on ? HIGH : LOW);
+#else
+  if (frameDump == NULL) {
+    mvwaddch(stdscr, 3, 10, status_on ? '*' : ' ');
+  }
+#endif
+  if (interval_decreasing) {
+    interval /= interval_factor;
+    if (interval <= min_interval) {
+      interval = min_interval;
+      interval_decreasing = false;
+    }
+  } else {
+    interval *= interval_factor;
+    if (interval >= max_interval) {
+      interval = max_interval;
+      interval_decreasing = true;
+    }
+  }
+  scheduler.SetPeriod(status_task, interval);
+}
+
+void StartTasks() {
+#ifdef ARDUINO
+  pinMode(LED_BUILTIN, OUTPUT);
+#endif
+  scheduler.Start(SyncedMillis());
+  strip_task = scheduler.Add("strip", strip_interval, StepStrip);
+  status_task = scheduler.Add("status", interval, BlinkStatus);
+  state_task = scheduler.Add("state", kStateSavePeriodMs, SaveState);
+#ifdef CONTROL_PORT
+  if (syncLeader) {
+    sync_task = scheduler.Add("sync", kSyncPeriodMs, SendSync);
+  }
+#endif
+}
+
 void setup() {
 #if defined(__AVR_ATtiny85__) && (F_CPU == 16000000L)
   clock_prescale_set(clock_div_1); // Enable 16 MHz on Trinket
 #endif
 
+  // Before anything else takes the heap.  Without the RAM it runs on the
+  // fallback table, with only a few steps a fade.
+  if (!gradient.Reserve(GradientEntries(numSteps))) {
+    numSteps = 1;
+  }
   sequence = color_seq_seq[0];
+  gradient.Build();
 
   mystrip = CreateStrip(nLEDS);
 
   // Start up the LED strip
   mystrip->begin();
+  RestoreState();
 
-  // Update the strip, to start they are all 'off'
+  // Black, or where the last snapshot left off.
   mystrip->show();
 
-  pixel = 0;
+#if defined(CONTROL_PORT) && defined(ARDUINO)
+  Serial.begin(115200);
+#endif
+  StartTasks();
+}
+
+void loop() {
+  ServiceControl();
+  stateStore.Poll();
+  scheduler.Run(SyncedMillis());
 }
 
 #ifndef ARDUINO
-long millis() {
-  static long now = 0;
-  long ret = now;
-  now += strip_interval;
-  return ret;
+void ReportTasks(FILE* out) {
+  for (uint8_t id = 0; id < scheduler.count(); id++) {
+    const TaskStats& stats = scheduler.Stats(id);
+    fprintf(out, "%-8s every %6lu ms: %lu runs, %lu late (worst %u ms), "
+            "%lu overruns\n", stats.name, (unsigned long)stats.period,
+            (unsigned long)stats.runs, (unsigned long)stats.late,
+            stats.worst_late, (unsigned long)stats.overruns);
+  }
 }
-#endif
 
+// Opens a pty to stand in for the board's serial port and returns the
+// name of the end to give tools/strandctl, or NULL.  The sketch's end is
+// controlFd; this end is also held open, in raw mode, so the line
+// discipline passes bytes straight through and the port outlives each
+// client.
+const char* OpenControlPty() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("pty");
+    return NULL;
+  }
+  const char* name = ptsname(master);
+  int client = open(name, O_RDWR | O_NOCTTY);
+  struct termios raw;
+  if (client < 0 || tcgetattr(client, &raw) != 0) {
+    perror(name);
+    return NULL;
+  }
+  cfmakeraw(&raw);
+  tcsetattr(client, TCSANOW, &raw);
+  fcntl(master, F_SETFL, O_NONBLOCK);
+  controlFd = master;
+  return name;
+}
 
-void loop() {
-  // check to see if it's time to blink the LED; that is, if the 
-  // difference between the current time and last time you blinked 
-  // the LED is bigger than the interval at which you want to 
-  // blink the LED.
-  unsigned long currentMillis = millis();
- 
-  // Adjust the light strip.
-  if (currentMillis - strip_last_change_millis > strip_interval) {
-    strip_last_change_millis = currentMillis;
-    mystrip->StepColor(pixel);
-    mystrip->show();
-
-    pixel += 1;
-    if (pixel == mystrip->numPixels()) {
-      pixel = 0;
-      iterations += 1;
-      if (iterations % kIterationThreshold == 0) {
-        sequence = color_seq_seq[(iterations / kIterationThreshold) % kColorSeqLen];
+int main(int argc, char** argv) {
+  int max_loops = 10000;
+  const char* control_port = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:i:P:pLE:")) != -1) {
+    switch (opt) {
+    case 'r':
+      // Dump raw frames for bake-animation instead of drawing.
+      frameDump = fopen(optarg, "wb");
+      if (frameDump == NULL) {
+        perror(optarg);
+        return 1;
+      }
+      break;
+    case 'i':
+      max_loops = atoi(optarg);
+      break;
+    case 'P':
+      // What to do when a frame runs past its deadline.
+      if (strcmp(optarg, "skip") == 0) {
+        pacer.SetPolicy(kPacerSkip);
+      } else if (strcmp(optarg, "catchup") == 0) {
+        pacer.SetPolicy(kPacerCatchUp);
+      } else {
+        fprintf(stderr, "-P takes catchup or skip\n");
+        return 1;
+      }
+      break;
+    case 'p':
+      // Take commands from tools/strandctl through a pty.
+      control_port = OpenControlPty();
+      if (control_port == NULL) {
+        return 1;
+      }
+      fprintf(stderr, "control port: %s\n", control_port);
+      break;
+    case 'L':
+      // Lead the boards (or other -p copies) listening on the control
+      // port; see kCmdSync.
+      syncLeader = true;
+      break;
+    case 'E':
+      // Keep state snapshots in this file, as the board does in EEPROM.
+      if (!eeprom.Open(optarg)) {
+        return 1;
       }
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r raw-frame-file] [-i loops] "
+              "[-P catchup|skip] [-p] [-L] [-E eeprom-file]\n", argv[0]);
+      return 1;
     }
   }
-}
 
-#ifndef ARDUINO
-int main(void) {
+  if (frameDump != NULL) {
+    // Simulated time, so the dump doesn't depend on this machine.
+    pacer.SetVirtual(true);
+    pacer.Start();
+    setup();
+    for (int count = 0; count < max_loops; count++) {
+      loop();
+      pacer.Wait(1000);
+    }
+    fclose(frameDump);
+    pacer.Report(stderr);
+    ReportTasks(stderr);
+    return 0;
+  }
+
   initscr();
   start_color();
   if (!can_change_color()) {
@@ -448,18 +1207,24 @@ int main(void) {
   bkgd(COLOR_PAIR(128));
   printw("max colors: %d\n", COLORS);
   printw("max pairs: %d\n", COLOR_PAIRS);
-  usleep(1000 * 1000);
+  if (control_port != NULL) {
+    printw("control port: %s\n", control_port);
+  }
+  pacer.Start();
   setup();
 
+  // The board spins on loop(), which polls millis(); one pass per
+  // millisecond sees every change of millis() the same way.
   int count = 0;
   do {
     loop();
-    usleep(10 * 1000);
-    count++;
-  } while (count++ < 10000); //true); // count++ < 1000);
+    pacer.Wait(1000);
+  } while (count++ < max_loops); //true); // count++ < 1000);
   endwin();
   printf("max colors: %d\n", COLORS);
   printf("max pairs: %d\n", COLOR_PAIRS);
+  pacer.Report(stdout);
+  ReportTasks(stdout);
   return 0;
 }
 #endif
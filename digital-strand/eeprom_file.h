@@ -0,0 +1,74 @@
+#ifndef EEPROM_FILE_H
+#define EEPROM_FILE_H
+
+// Host-only stand-in for the board's EEPROM (-E), so state_store.h's
+// snapshots survive between runs and can be looked at or damaged on
+// purpose.  Unwritten bytes, past the end of the file or with no file at
+// all, read as 0xff like erased EEPROM.
+
+#include <stdint.h>
+#include <stdio.h>
+
+class EepromFile {
+public:
+  EepromFile():
+    file_(NULL), writes_(0) {};
+
+  ~EepromFile() {
+    if (file_ != NULL) {
+      fclose(file_);
+    }
+  };
+
+  // Creates the file if need be; prints what's wrong and returns false
+  // when it can't be opened.
+  bool Open(const char* path) {
+    file_ = fopen(path, "r+b");
+    if (file_ == NULL) {
+      file_ = fopen(path, "w+b");
+    }
+    if (file_ == NULL) {
+      perror(path);
+      return false;
+    }
+    return true;
+  };
+
+  bool Ready() {
+    return file_ != NULL;
+  };
+
+  uint8_t Read(uint16_t address) {
+    if (file_ == NULL || fseek(file_, address, SEEK_SET) != 0) {
+      return 0xff;
+    }
+    int value = fgetc(file_);
+    return value == EOF ? 0xff : value;
+  };
+
+  void Write(uint16_t address, uint8_t value) {
+    if (file_ == NULL) {
+      return;
+    }
+    // Fill any gap with erased bytes.
+    fseek(file_, 0, SEEK_END);
+    for (long end = ftell(file_); end < address; end++) {
+      fputc(0xff, file_);
+    }
+    fseek(file_, address, SEEK_SET);
+    fputc(value, file_);
+    fflush(file_);
+    writes_++;
+  };
+
+  // Bytes written, for comparing against the EEPROM's endurance.
+  uint32_t writes() {
+    return writes_;
+  };
+
+private:
+  FILE* file_;
+  uint32_t writes_;
+};
+
+#endif  // EEPROM_FILE_H
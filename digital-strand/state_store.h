@@ -0,0 +1,138 @@
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+// Keeps the animation's place in EEPROM, so after a brownout or a power
+// cycle the strip carries on from about where it was instead of starting
+// over from black.
+//
+// Each snapshot is a kStateRecord-byte record, written to the next of
+// kStateSlots slots in turn so the writes are spread over all of them
+// (an EEPROM cell is good for about 100,000 writes; at one snapshot a
+// minute the ring lasts years).  Records carry an 8-bit counter, one
+// more than the previous record's; the newest is the valid record whose
+// next slot doesn't hold its successor.
+//
+// A record is written back to front, so its counter and then its magic
+// byte go in last.  One cut short by a power failure still has the
+// counter of the record it was overwriting (or, in a fresh slot, no
+// magic), so even if its 8-bit checksum happens to add up it can't pass
+// for the newest, and the one before it is used instead.
+//
+// An EEPROM byte takes about 3.3 ms to write on an AVR, so Save() only
+// stages the record and Poll() writes one byte at a time, whenever the
+// EEPROM is ready, rather than holding up a dozen frames.
+//
+// Storage is anything with
+//   bool Ready()
+//   uint8_t Read(uint16_t address)
+//   void Write(uint16_t address, uint8_t value)
+// (avr/eeprom.h on the board, eeprom_file.h on the host).
+
+#include <stdint.h>
+
+#include "control_protocol.h"
+
+#define kStateMagic 0x5d
+#define kStateRecord 12
+#define kStateSlots 40
+#define kStateBytes (kStateRecord * kStateSlots)
+
+struct AnimationState {
+  uint32_t frame;
+  uint8_t sequence_index;
+  uint8_t steps;
+  uint8_t scale;
+  uint16_t interval;
+};
+
+template <class Storage>
+class StateStore {
+public:
+  explicit StateStore(Storage* storage):
+    storage_(storage), slot_(kStateSlots - 1), counter_(0xff),
+    pending_(kStateRecord), saves_(0) {};
+
+  // Finds the newest snapshot; returns false when there is none.
+  bool Load(AnimationState* state) {
+    uint8_t record[kStateRecord];
+    for (uint8_t slot = 0; slot < kStateSlots; slot++) {
+      if (!ReadSlot(slot, record)) {
+        continue;
+      }
+      uint8_t next[kStateRecord];
+      uint8_t counter = record[1];
+      if (ReadSlot((slot + 1) % kStateSlots, next)
+          && next[1] == (uint8_t)(counter + 1)) {
+        continue;
+      }
+      slot_ = slot;
+      counter_ = counter;
+      state->frame = ControlGetU32(record + 2);
+      state->sequence_index = record[6];
+      state->steps = record[7];
+      state->scale = record[8];
+      state->interval = ControlGetU16(record + 9);
+      return true;
+    }
+    return false;
+  };
+
+  // Starts writing `state` to the next slot.  A snapshot still being
+  // written is abandoned, which leaves it as torn as a power failure
+  // would.
+  void Save(const AnimationState& state) {
+    slot_ = (slot_ + 1) % kStateSlots;
+    counter_++;
+    record_[0] = kStateMagic;
+    record_[1] = counter_;
+    uint8_t* p = ControlPutU32(record_ + 2, state.frame);
+    *p++ = state.sequence_index;
+    *p++ = state.steps;
+    *p++ = state.scale;
+    ControlPutU16(p, state.interval);
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < kStateRecord - 1; i++) {
+      sum += record_[i];
+    }
+    record_[kStateRecord - 1] = -sum;
+    pending_ = 0;
+    saves_++;
+  };
+
+  // Writes the next byte of the snapshot, if any, when the storage can
+  // take it; the last byte first.
+  void Poll() {
+    if (pending_ == kStateRecord || !storage_->Ready()) {
+      return;
+    }
+    uint8_t i = kStateRecord - 1 - pending_;
+    uint16_t address = (uint16_t)slot_ * kStateRecord + i;
+    if (storage_->Read(address) != record_[i]) {
+      storage_->Write(address, record_[i]);
+    }
+    pending_++;
+  };
+
+  uint32_t saves() {
+    return saves_;
+  };
+
+private:
+  bool ReadSlot(uint8_t slot, uint8_t* record) {
+    uint8_t sum = 0;
+    for (uint8_t i = 0; i < kStateRecord; i++) {
+      record[i] = storage_->Read((uint16_t)slot * kStateRecord + i);
+      sum += record[i];
+    }
+    return record[0] == kStateMagic && sum == 0;
+  };
+
+  Storage* storage_;
+  uint8_t slot_;
+  uint8_t counter_;
+  uint8_t record_[kStateRecord];
+  uint8_t pending_;
+  uint32_t saves_;
+};
+
+#endif  // STATE_STORE_H
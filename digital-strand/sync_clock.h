@@ -0,0 +1,125 @@
+#ifndef SYNC_CLOCK_H
+#define SYNC_CLOCK_H
+
+// A local clock disciplined to a leader's, so several boards running the
+// same sketch stay in step.
+//
+// The leader broadcasts its time now and then; each follower compares it
+// with its own idea of the leader's time and steers towards it with a
+// phase-locked loop: a quarter of the phase error is taken at once, and
+// the rate is trimmed by a quarter of the error over the time since the
+// last message, so a board whose crystal runs fast is slowed down rather
+// than jerked back every time.  Errors past kSyncStepUs (start-up, or a
+// long gap) are taken in one jump.
+//
+// Rates are in 2^-20ths (about 1 ppm), up to +-kSyncMaxRate, which covers
+// the ceramic resonators on Unos.  Times are microseconds; the synced
+// time is 64 bits so it doesn't wrap with micros().
+
+#include <stdint.h>
+
+#include "control_protocol.h"
+
+#define kSyncStepUs 50000
+#define kSyncMaxRate 8191
+
+class SyncClock {
+public:
+  SyncClock():
+    anchor_local_(0), anchor_synced_(0), rate_(0), last_update_(0),
+    locked_(false) {};
+
+  // The synced time at local time `local`, which must not be earlier
+  // than at the last call.
+  uint64_t Micros(uint32_t local) {
+    uint32_t elapsed = local - anchor_local_;
+    // Move the anchor along well before local time wraps.
+    if (elapsed >= (1UL << 18)) {
+      anchor_synced_ += elapsed + Correction(elapsed);
+      anchor_local_ = local;
+      elapsed = 0;
+    }
+    return anchor_synced_ + elapsed + Correction(elapsed);
+  };
+
+  // Jumps to `synced` at local time `local`, keeping the rate and without
+  // counting as a message from the leader.
+  void Set(uint64_t synced, uint32_t local) {
+    anchor_synced_ = synced;
+    anchor_local_ = local;
+  };
+
+  // The leader's time was `leader` at local time `local`.
+  void Update(uint64_t leader, uint32_t local) {
+    int64_t error = (int64_t)(leader - Micros(local));
+    uint32_t since = local - last_update_;
+    last_update_ = local;
+    if (!locked_ || error > kSyncStepUs || error < -kSyncStepUs) {
+      anchor_synced_ = leader;
+      anchor_local_ = local;
+      locked_ = true;
+      return;
+    }
+    anchor_synced_ += error / 4;
+    // error / since / 4 in 2^-20ths, with since in 1024 us units so the
+    // product stays within 32 bits.
+    if (since >= 1024) {
+      int32_t rate = rate_ + ((int32_t)error * 256) / (int32_t)(since >> 10);
+      if (rate > kSyncMaxRate) {
+        rate = kSyncMaxRate;
+      } else if (rate < -kSyncMaxRate) {
+        rate = -kSyncMaxRate;
+      }
+      rate_ = rate;
+    }
+  };
+
+  bool locked() {
+    return locked_;
+  };
+
+  // How much faster than the local clock the synced one runs.
+  int16_t rate() {
+    return rate_;
+  };
+
+private:
+  int32_t Correction(uint32_t elapsed) {
+    return ((int64_t)elapsed * rate_) >> 20;
+  };
+
+  uint32_t anchor_local_;
+  uint64_t anchor_synced_;
+  int16_t rate_;
+  uint32_t last_update_;
+  bool locked_;
+};
+
+// kCmdSync's payload: the frame number, microseconds into the frame and
+// the frame length in milliseconds.
+#define kSyncPayload 10
+
+// How long kCmdSync takes on the wire at 115200 baud, which followers add
+// to the time in it.
+#define kSyncTransitUs ((kSyncPayload + 4) * 10 * 1000000UL / 115200)
+
+inline uint8_t SyncPack(uint64_t synced, uint16_t interval, uint8_t* out) {
+  uint32_t frame_us = interval * 1000UL;
+  uint32_t frame = synced / frame_us;
+  uint8_t* p = ControlPutU32(out, frame);
+  p = ControlPutU32(p, synced - (uint64_t)frame * frame_us);
+  ControlPutU16(p, interval);
+  return kSyncPayload;
+}
+
+inline uint16_t SyncInterval(const uint8_t* payload) {
+  return ControlGetU16(payload + 8);
+}
+
+// The sender's time when the message arrived.
+inline uint64_t SyncTime(const uint8_t* payload) {
+  return (uint64_t)ControlGetU32(payload) * SyncInterval(payload) * 1000
+      + ControlGetU32(payload + 4) + kSyncTransitUs;
+}
+
+#endif  // SYNC_CLOCK_H
@@ -0,0 +1,184 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Runs periodic tasks, each at its own rate, from one millisecond clock.
+//
+// Tasks hang off a wheel of kWheelSlots lists, in the slot their next run
+// falls in (due time modulo kWheelSlots).  Each tick of Run() looks only
+// at that tick's slot, so the cost per tick doesn't grow with the number
+// of tasks or their periods; a task whose next run is more than one turn
+// of the wheel away just stays put until the turn it's due.  Tasks due on
+// the same tick run in the order they were added.
+//
+// A task that runs late (Run() wasn't called for a while, or an earlier
+// task took too long) counts as late, and if its next run has passed too
+// it counts as an overrun and starts its period over from now rather
+// than running several times to catch up.
+//
+// The clock can also be stepped (a synced clock locking on to a leader
+// that has been up for hours, or a leader rebooting).  Stepping through
+// hours of ticks one at a time would hold up loop() for seconds, and
+// waiting for a clock that went back would stop every task, so when time
+// goes backwards, or forwards by more than kWheelMaxLag, the wheel is
+// rebased instead: every task keeps the time it had left to run.
+
+#include <stdint.h>
+
+#define kWheelSlots 16
+#define kWheelMaxTasks 4
+#define kNoTask 0xff
+// Ms; Run() coming later than this is taken as a step of the clock.
+#define kWheelMaxLag 1000
+
+struct TaskStats {
+  const char* name;
+  uint32_t period;
+  uint32_t runs;
+  uint32_t late;      // Runs after the tick they were due.
+  uint32_t overruns;  // Periods dropped because of lateness.
+  uint16_t worst_late;  // Milliseconds.
+};
+
+class TimerWheel {
+public:
+  TimerWheel():
+    tick_(0), ticks_(0), steps_(0), count_(0) {
+    for (uint8_t slot = 0; slot < kWheelSlots; slot++) {
+      heads_[slot] = kNoTask;
+    }
+  };
+
+  // Starts the clock at `now`; tasks added later first run one period
+  // after it.
+  void Start(uint32_t now) {
+    tick_ = now;
+  };
+
+  // Adds a task that runs every `period` (at least 1) milliseconds.
+  // Returns its id, or kNoTask when the wheel is full.
+  uint8_t Add(const char* name, uint32_t period, void (*run)()) {
+    if (count_ == kWheelMaxTasks) {
+      return kNoTask;
+    }
+    uint8_t id = count_++;
+    Task& task = tasks_[id];
+    task.run = run;
+    task.due = tick_ + period;
+    task.stats.name = name;
+    task.stats.period = period;
+    task.stats.runs = 0;
+    task.stats.late = 0;
+    task.stats.overruns = 0;
+    task.stats.worst_late = 0;
+    Link(id);
+    return id;
+  };
+
+  // Takes effect from the task's next run.
+  void SetPeriod(uint8_t id, uint32_t period) {
+    tasks_[id].stats.period = period;
+  };
+
+  uint8_t count() {
+    return count_;
+  };
+
+  const TaskStats& Stats(uint8_t id) {
+    return tasks_[id].stats;
+  };
+
+  // Runs everything due up to and including `now`.
+  void Run(uint32_t now) {
+    int32_t behind = now - tick_;
+    if (behind < 0 || behind > kWheelMaxLag) {
+      Rebase(now);
+      return;
+    }
+    while (behind-- > 0) {
+      tick_++;
+      ticks_++;
+      Dispatch(now);
+    }
+  };
+
+  // Ticks stepped through so far.
+  uint32_t ticks() {
+    return ticks_;
+  };
+
+  // Times the clock was taken to have been stepped.
+  uint32_t steps() {
+    return steps_;
+  };
+
+private:
+  struct Task {
+    void (*run)();
+    uint32_t due;
+    uint8_t next;
+    TaskStats stats;
+  };
+
+  // Puts task `id` in its slot, keeping each slot in id order.
+  void Link(uint8_t id) {
+    uint8_t* link = &heads_[tasks_[id].due % kWheelSlots];
+    while (*link != kNoTask && *link < id) {
+      link = &tasks_[*link].next;
+    }
+    tasks_[id].next = *link;
+    *link = id;
+  };
+
+  // Moves the wheel and every task's next run along to `now`.
+  void Rebase(uint32_t now) {
+    uint32_t shift = now - tick_;
+    for (uint8_t slot = 0; slot < kWheelSlots; slot++) {
+      heads_[slot] = kNoTask;
+    }
+    for (uint8_t id = 0; id < count_; id++) {
+      tasks_[id].due += shift;
+      Link(id);
+    }
+    tick_ = now;
+    steps_++;
+  };
+
+  void Dispatch(uint32_t now) {
+    uint8_t* link = &heads_[tick_ % kWheelSlots];
+    while (*link != kNoTask) {
+      uint8_t id = *link;
+      Task& task = tasks_[id];
+      if (task.due != tick_) {
+        link = &task.next;
+        continue;
+      }
+      *link = task.next;
+
+      uint32_t late = now - tick_;
+      if (late > 0) {
+        task.stats.late++;
+        if (late > task.stats.worst_late) {
+          task.stats.worst_late = late > 0xffff ? 0xffff : late;
+        }
+      }
+      task.stats.runs++;
+      task.run();
+
+      task.due = tick_ + task.stats.period;
+      if ((int32_t)(task.due - now) <= 0) {
+        task.stats.overruns++;
+        task.due = now + task.stats.period;
+      }
+      Link(id);
+    }
+  };
+
+  uint32_t tick_;
+  uint32_t ticks_;
+  uint32_t steps_;
+  uint8_t count_;
+  uint8_t heads_[kWheelSlots];
+  Task tasks_[kWheelMaxTasks];
+};
+
+#endif  // TIMER_WHEEL_H
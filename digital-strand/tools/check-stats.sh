@@ -0,0 +1,63 @@
+#!/bin/bash
+
+# Usage: check-stats.sh sketch strandctl
+# Runs the host build of the sketch as a sync leader with a control port,
+# asks it for stats and fails unless the reply has every task a leader
+# runs (strip, status, state and sync).  Then sets scale 2 and fails
+# unless the frames shown after it stay within the LPD8806's 7 bits a
+# channel with the brightest colors at full, rather than wrapping dark.
+# Build the sketch with -fsanitize=address so an overrun in a reply
+# fails it too.
+
+sketch=$1
+strandctl=$2
+tasks=4
+
+log=$(mktemp)
+eeprom=$(mktemp)
+frames=$(mktemp)
+trap 'kill $pid 2>/dev/null; rm -f "$log" "$eeprom" "$frames"' EXIT
+
+"$sketch" -L -p -E "$eeprom" -r "$frames" -i 2000000000 2>"$log" &
+pid=$!
+
+port=
+for i in $(seq 50); do
+  port=$(sed -n 's/^control port: //p' "$log")
+  [ -n "$port" ] && break
+  sleep 0.1
+done
+if [ -z "$port" ]; then
+  echo "check-stats: the sketch opened no control port" >&2
+  cat "$log" >&2
+  exit 1
+fi
+
+stats=$("$strandctl" -d "$port" stats 2>&1)
+status=$?
+echo "$stats"
+if [ $status -ne 0 ] || ! kill -0 $pid 2>/dev/null; then
+  echo "check-stats: no stats reply" >&2
+  cat "$log" >&2
+  exit 1
+fi
+got=$(echo "$stats" | grep -c '^task ')
+if [ "$got" -ne $tasks ]; then
+  echo "check-stats: $got tasks in the reply, expected $tasks" >&2
+  exit 1
+fi
+
+# The reply comes once a frame with the new scale is shown, so everything
+# written after it is scaled.
+if ! "$strandctl" -d "$port" scale 2; then
+  echo "check-stats: scale 2 wasn't taken" >&2
+  exit 1
+fi
+from=$(($(stat -c %s "$frames") + 1))
+sleep 0.5
+brightest=$(tail -c +$from "$frames" | head -c 1000000 | od -An -tu1 -v \
+  | tr -s ' ' '\n' | sort -nu | tail -1)
+if [ "$brightest" != 127 ]; then
+  echo "check-stats: brightest channel at scale 2 is $brightest, not 127" >&2
+  exit 1
+fi
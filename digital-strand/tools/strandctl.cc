@@ -0,0 +1,190 @@
+// Sends control commands to digital-strand over a serial port, or to the
+// simulator's pty (digital-strand -p), and reports how long each took to
+// show.
+//
+// Usage: strandctl -d device [-n repeats] command [args]
+//
+//   steps N        fade steps (1-64)
+//   interval MS    milliseconds per pixel step (1-10000)
+//   scale N        color scale (1-4)
+//   sequence I     color sequence (0-2)
+//   stats          print the sketch's counters and task stats
+//   ping           round trip only
+//
+// Set commands are answered once the change is on the strip, so their
+// latency is command to visible change.  With -n the command is sent that
+// many times and the latencies are summarized.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../control_protocol.h"
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Raw 115200 8N1, as the sketch's Serial.begin(); a pty ignores the rate.
+int OpenPort(const char* device) {
+  int fd = open(device, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(device);
+    return -1;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+// Waits up to a second for the reply to `command`.  Returns its length,
+// or -1.
+int AwaitReply(int fd, uint8_t command, uint8_t* payload) {
+  ControlParser parser;
+  double deadline = Now() + 1.0;
+  while (Now() < deadline) {
+    struct pollfd ready = {fd, POLLIN, 0};
+    if (poll(&ready, 1, (deadline - Now()) * 1000 + 1) <= 0) {
+      continue;
+    }
+    uint8_t buffer[64];
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < got; i++) {
+      if (parser.Feed(buffer[i])
+          && parser.command() == (command | kControlReply)) {
+        memcpy(payload, parser.payload(), parser.length());
+        return parser.length();
+      }
+    }
+  }
+  return -1;
+}
+
+void PrintStats(const uint8_t* p, int length) {
+  if (length < 13) {
+    printf("short stats reply\n");
+    return;
+  }
+  printf("iterations %lu, steps %d, interval %d ms, scale %d, sequence %d, "
+         "%d bad messages\n", (unsigned long)ControlGetU32(p), p[4],
+         ControlGetU16(p + 5), p[7], p[8], ControlGetU16(p + 9));
+  const uint8_t* task = p + 12;
+  for (int id = 0; id < p[11] && task + 14 <= p + length; id++, task += 14) {
+    printf("task %d: %lu runs, %lu late (worst %d ms), %lu overruns\n", id,
+           (unsigned long)ControlGetU32(task),
+           (unsigned long)ControlGetU32(task + 4),
+           ControlGetU16(task + 12),
+           (unsigned long)ControlGetU32(task + 8));
+  }
+}
+
+void Usage() {
+  fprintf(stderr, "usage: strandctl -d device [-n repeats] "
+          "steps N | interval MS | scale N | sequence I | stats | ping\n");
+}
+
+int main(int argc, char** argv) {
+  const char* device = NULL;
+  int repeats = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+    switch (opt) {
+    case 'd': device = optarg; break;
+    case 'n': repeats = atoi(optarg); break;
+    default:
+      Usage();
+      return 1;
+    }
+  }
+  if (device == NULL || optind >= argc || repeats < 1) {
+    Usage();
+    return 1;
+  }
+
+  const char* name = argv[optind];
+  bool has_value = optind + 1 < argc;
+  unsigned long value = has_value ? strtoul(argv[optind + 1], NULL, 0) : 0;
+  uint8_t command;
+  uint8_t payload[kControlMaxPayload];
+  uint8_t length = 0;
+  if (strcmp(name, "steps") == 0 || strcmp(name, "interval") == 0
+      || strcmp(name, "scale") == 0) {
+    command = kCmdSetParam;
+    payload[0] = name[0] == 's' ? (name[1] == 't' ? kParamSteps : kParamScale)
+                                : kParamInterval;
+    ControlPutU16(payload + 1, value);
+    length = 3;
+  } else if (strcmp(name, "sequence") == 0) {
+    command = kCmdSetSequence;
+    payload[0] = value;
+    length = 1;
+  } else if (strcmp(name, "stats") == 0) {
+    command = kCmdGetStats;
+  } else if (strcmp(name, "ping") == 0) {
+    command = kCmdPing;
+    memcpy(payload, "ping", 4);
+    length = 4;
+  } else {
+    Usage();
+    return 1;
+  }
+  if ((command == kCmdSetParam || command == kCmdSetSequence) && !has_value) {
+    Usage();
+    return 1;
+  }
+
+  int fd = OpenPort(device);
+  if (fd < 0) {
+    return 1;
+  }
+
+  double total = 0, best = 1e9, worst = 0;
+  for (int i = 0; i < repeats; i++) {
+    uint8_t message[kControlMaxMessage];
+    uint8_t size = ControlFrame(command, payload, length, message);
+    double start = Now();
+    if (write(fd, message, size) != size) {
+      perror(device);
+      return 1;
+    }
+    uint8_t reply[kControlMaxPayload];
+    int got = AwaitReply(fd, command, reply);
+    double ms = (Now() - start) * 1000;
+    if (got < 1) {
+      fprintf(stderr, "no reply\n");
+      return 1;
+    }
+    if (reply[0] != kStatusOk) {
+      fprintf(stderr, "%s\n", reply[0] == kStatusBadValue
+              ? "value out of range" : reply[0] == kStatusNoMemory
+              ? "not enough memory on the board" : "command not understood");
+      return 1;
+    }
+    if (command == kCmdGetStats && i == repeats - 1) {
+      PrintStats(reply + 1, got - 1);
+    }
+    total += ms;
+    best = ms < best ? ms : best;
+    worst = ms > worst ? ms : worst;
+  }
+  if (repeats == 1) {
+    printf("%s: %.2f ms\n", name, total);
+  } else {
+    printf("%s x %d: %.2f ms average, %.2f best, %.2f worst\n", name,
+           repeats, total / repeats, best, worst);
+  }
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Simulates several boards keeping time with sync_clock.h and reports how
+// far apart their frame clocks are.
+//
+// Usage: sync-sim [-n nodes] [-d ppm] [-s seconds] [-p ms] [-u hours]
+//                 [-r seconds]
+//
+//   -n N    boards, the first being the leader (default 4)
+//   -d PPM  worst crystal error, each board gets a random one up to
+//           this either way (default 5000, a ceramic resonator)
+//   -s N    seconds to simulate (default 120)
+//   -p MS   milliseconds between the leader's syncs (default 250)
+//   -u N    hours the leader has been up at the start (default 0)
+//   -r N    the leader reboots N seconds in (default never)
+//
+// Each board has its own local microsecond clock, running at its own
+// rate from a random start.  The leader writes kCmdSync to a pipe per
+// follower one byte per 87 us, as the serial line would carry it, and
+// each follower polls its pipe every 100 us of its own time, as loop()
+// would.  Every second the worst skew between any follower and the
+// leader is printed, then the worst and mean after the first lock.
+//
+// Each follower also drives timer_wheel.h from its synced clock, as
+// loop() does, with a task every frame.  -u and -r step that clock, far
+// forwards when the followers first lock on and far back when the leader
+// comes back from a reboot; the wheel should take both in its stride.
+// The most ticks any one Run() had to step through, and the longest any
+// follower went without running its frame task, are printed at the end.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../control_protocol.h"
+#include "../sync_clock.h"
+#include "../timer_wheel.h"
+
+#define kByteUs 87
+#define kPollUs 100
+#define kFrameMs 2
+
+struct Node {
+  double rate;    // Local microseconds per real one.
+  double start;   // Local time at real time 0.
+  SyncClock clock;
+  ControlParser parser;
+  int pipe_in;
+  int pipe_out;
+  double next_poll;
+  TimerWheel wheel;
+  uint32_t most_ticks;
+
+  uint32_t Local(double now) {
+    return (uint64_t)(start + now * rate);
+  };
+};
+
+// The frame task: when the follower being polled last ran it.
+double frameNow;
+double lastFrame;
+double longestGap;
+
+void Frame() {
+  if (frameNow - lastFrame > longestGap) {
+    longestGap = frameNow - lastFrame;
+  }
+  lastFrame = frameNow;
+}
+
+void Usage() {
+  fprintf(stderr, "usage: sync-sim [-n nodes] [-d ppm] [-s seconds] "
+          "[-p ms] [-u hours] [-r seconds]\n");
+}
+
+int main(int argc, char** argv) {
+  int nodes = 4;
+  double ppm = 5000;
+  int seconds = 120;
+  int period_ms = 250;
+  double uptime_hours = 0;
+  int reboot = -1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:s:p:u:r:")) != -1) {
+    switch (opt) {
+    case 'n': nodes = atoi(optarg); break;
+    case 'd': ppm = atof(optarg); break;
+    case 's': seconds = atoi(optarg); break;
+    case 'p': period_ms = atoi(optarg); break;
+    case 'u': uptime_hours = atof(optarg); break;
+    case 'r': reboot = atoi(optarg); break;
+    default:
+      Usage();
+      return 1;
+    }
+  }
+  if (nodes < 2 || seconds < 1 || period_ms < 1 || ppm < 0
+      || uptime_hours < 0 || uptime_hours > 1000) {
+    Usage();
+    return 1;
+  }
+
+  srand(1);
+  std::vector<Node> node(nodes);
+  for (int i = 0; i < nodes; i++) {
+    node[i].rate = 1 + ppm * 1e-6 * (2.0 * rand() / RAND_MAX - 1);
+    node[i].start = 1e7 * rand() / RAND_MAX;
+    node[i].next_poll = 0;
+    int fds[2];
+    if (pipe(fds) != 0) {
+      perror("pipe");
+      return 1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    node[i].pipe_in = fds[0];
+    node[i].pipe_out = fds[1];
+    node[i].wheel.Start(0);
+    node[i].wheel.Add("frame", kFrameMs, Frame);
+    node[i].most_ticks = 0;
+  }
+  node[0].clock.Set(uptime_hours * 3600e6, node[0].Local(0));
+  // Each follower's frame task, last run at real time 0.
+  std::vector<double> last_frame(nodes, 0);
+  double longest_gap = 0;
+
+  // The message on the wire, and when its next byte goes out.
+  uint8_t message[kControlMaxMessage];
+  int message_size = 0;
+  int sent = 0;
+  double next_byte = 0;
+  double next_sync = 0;
+
+  double worst = 0, sum = 0;
+  long samples = 0;
+  double window_worst = 0;
+  bool all_locked = false;
+
+  for (double now = 0; now < seconds * 1e6; now += 10) {
+    Node& leader = node[0];
+    if (reboot >= 0 && now == reboot * 1e6) {
+      // Starts over from a local time of zero, and so a synced one.
+      leader.start = -now * leader.rate;
+      leader.clock = SyncClock();
+    }
+    if (now >= next_sync && sent == message_size) {
+      uint8_t payload[kSyncPayload];
+      SyncPack(leader.clock.Micros(leader.Local(now)), kFrameMs, payload);
+      message_size = ControlFrame(kCmdSync, payload, kSyncPayload, message);
+      sent = 0;
+      next_byte = now;
+      next_sync += period_ms * 1000.0 / leader.rate;
+    }
+    if (sent < message_size && now >= next_byte) {
+      for (int i = 1; i < nodes; i++) {
+        if (write(node[i].pipe_out, &message[sent], 1) != 1) {
+          perror("write");
+          return 1;
+        }
+      }
+      sent++;
+      next_byte += kByteUs;
+    }
+
+    for (int i = 1; i < nodes; i++) {
+      Node& follower = node[i];
+      if (now < follower.next_poll) {
+        continue;
+      }
+      follower.next_poll += kPollUs / follower.rate;
+      uint8_t byte;
+      while (read(follower.pipe_in, &byte, 1) == 1) {
+        if (follower.parser.Feed(byte)
+            && follower.parser.command() == kCmdSync) {
+          follower.clock.Update(SyncTime(follower.parser.payload()),
+                                follower.Local(now));
+        }
+      }
+      frameNow = now;
+      lastFrame = last_frame[i];
+      longestGap = longest_gap;
+      uint32_t ticks = follower.wheel.ticks();
+      follower.wheel.Run(follower.clock.Micros(follower.Local(now)) / 1000);
+      ticks = follower.wheel.ticks() - ticks;
+      if (ticks > follower.most_ticks) {
+        follower.most_ticks = ticks;
+      }
+      last_frame[i] = lastFrame;
+      longest_gap = longestGap;
+    }
+
+    if ((long)now % 1000 != 0) {
+      continue;
+    }
+    // The followers are a sync behind a rebooted leader for a moment.
+    if (reboot >= 0 && now >= reboot * 1e6 && now < (reboot + 1) * 1e6) {
+      continue;
+    }
+    if (!all_locked) {
+      all_locked = true;
+      for (int i = 1; i < nodes; i++) {
+        all_locked = all_locked && node[i].clock.locked();
+      }
+    }
+    double reference = leader.clock.Micros(leader.Local(now));
+    for (int i = 1; i < nodes && all_locked; i++) {
+      double skew = node[i].clock.Micros(node[i].Local(now)) - reference;
+      skew = skew < 0 ? -skew : skew;
+      window_worst = skew > window_worst ? skew : window_worst;
+      worst = skew > worst ? skew : worst;
+      sum += skew;
+      samples++;
+    }
+    if ((long)now % 1000000 == 0 && now > 0) {
+      printf("%4.0f s: worst skew %7.0f us\n", now / 1e6, window_worst);
+      window_worst = 0;
+    }
+  }
+
+  printf("rates (ppm):");
+  for (int i = 0; i < nodes; i++) {
+    printf(" %+.0f", (node[i].rate - 1) * 1e6);
+  }
+  printf("\nlearned corrections (ppm):");
+  for (int i = 1; i < nodes; i++) {
+    printf(" %+.0f", node[i].clock.rate() / 1.048576);
+  }
+  printf("\nskew after lock: worst %.0f us, mean %.0f us; frames are %d ms\n",
+         worst, samples ? sum / samples : 0.0, kFrameMs);
+  uint32_t most_ticks = 0;
+  uint32_t steps = 0;
+  for (int i = 1; i < nodes; i++) {
+    // Including one still waiting at the end.
+    if (seconds * 1e6 - last_frame[i] > longest_gap) {
+      longest_gap = seconds * 1e6 - last_frame[i];
+    }
+    most_ticks = node[i].most_ticks > most_ticks ? node[i].most_ticks
+                                                 : most_ticks;
+    steps += node[i].wheel.steps();
+  }
+  printf("timer wheel: %u clock steps, at most %u ticks in one Run(), "
+         "frame task at most %.1f ms apart\n", steps, most_ticks,
+         longest_gap / 1000);
+  return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef DSTRAND_ANIM_CODEC_H
+#define DSTRAND_ANIM_CODEC_H
+
+// Precompiled animations.
+//
+// Effects that are too expensive to compute live can be run on the host
+// (see the -r option of the ncurses build), baked by tools/bake-animation
+// and played back here.  Playback only costs decode time.
+//
+// Stream layout:
+//   header, kAnimHeaderSize bytes:
+//     'A' 'N' version pixels(u16 LE) frames(u16 LE) frame_ms
+//   then per frame a type byte (kAnimKeyFrame / kAnimDeltaFrame) followed
+//   by ops until every pixel of the frame is covered:
+//     0x00-0x7f  literal: (op + 1) pixels follow, 3 bytes (r, g, b) each
+//     0x80-0xbf  run: one pixel follows, repeated (op & 0x3f) + 1 times
+//     0xc0-0xff  skip: (op & 0x3f) + 1 pixels are unchanged from the
+//                previous frame (delta frames only)
+//
+// Delta frames are decoded straight into the strip's pixels, which still
+// hold the previous frame, so no extra frame buffer is needed.  The first
+// frame is always a key frame so playback can loop.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <avr/pgmspace.h>
+#else
+#  ifndef PROGMEM
+#    define PROGMEM
+#    define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#  endif
+#endif
+
+#define kAnimVersion 1
+#define kAnimHeaderSize 8
+
+#define kAnimKeyFrame 0
+#define kAnimDeltaFrame 1
+
+#define kAnimMaxLiteral 128
+#define kAnimMaxRun 64
+#define kAnimMaxSkip 64
+
+// Reads an animation out of flash.
+class ProgmemAnimReader {
+public:
+  ProgmemAnimReader(const uint8_t* data):
+    data_(data), pos_(0) {};
+
+  uint8_t Next() {
+    return pgm_read_byte(data_ + pos_++);
+  };
+
+  void Seek(uint32_t pos) {
+    pos_ = pos;
+  };
+
+private:
+  const uint8_t* data_;
+  uint32_t pos_;
+};
+
+// Reads an animation from anything with read() and seek(), such as an
+// SD library File.
+template <class Stream>
+class StreamAnimReader {
+public:
+  StreamAnimReader(Stream* stream):
+    stream_(stream) {};
+
+  uint8_t Next() {
+    return stream_->read();
+  };
+
+  void Seek(uint32_t pos) {
+    stream_->seek(pos);
+  };
+
+private:
+  Stream* stream_;
+};
+
+// Plays an animation into a Strip, one frame per NextFrame().
+template <class Reader>
+class AnimPlayer {
+public:
+  AnimPlayer(Reader reader):
+    reader_(reader), pixels_(0), frames_(0), frame_ms_(0), frame_(0),
+    valid_(false) {
+    reader_.Seek(0);
+    uint8_t header[kAnimHeaderSize];
+    for (int i = 0; i < kAnimHeaderSize; i++) {
+      header[i] = reader_.Next();
+    }
+    if (header[0] == 'A' && header[1] == 'N' && header[2] == kAnimVersion) {
+      pixels_ = header[3] | (header[4] << 8);
+      frames_ = header[5] | (header[6] << 8);
+      frame_ms_ = header[7];
+      valid_ = frames_ > 0;
+    }
+  };
+
+  bool valid() {
+    return valid_;
+  };
+
+  uint16_t numPixels() {
+    return pixels_;
+  };
+
+  uint8_t frameMillis() {
+    return frame_ms_;
+  };
+
+  // Decodes the next frame into strip; pixels past the strip's end are
+  // dropped.  Loops back to the start after the last frame.
+  template <class StripType>
+  void NextFrame(StripType* strip) {
+    if (!valid_) {
+      return;
+    }
+    if (frame_ == frames_) {
+      reader_.Seek(kAnimHeaderSize);
+      frame_ = 0;
+    }
+
+    reader_.Next();  // Frame type; only needed for seeking.
+    uint16_t limit = strip->numPixels();
+    uint16_t pixel = 0;
+    while (pixel < pixels_) {
+      uint8_t op = reader_.Next();
+      if (op < 0x80) {
+        for (uint8_t n = op + 1; n > 0; n--, pixel++) {
+          uint8_t r = reader_.Next();
+          uint8_t g = reader_.Next();
+          uint8_t b = reader_.Next();
+          if (pixel < limit) {
+            strip->setPixelColor(pixel, r, g, b);
+          }
+        }
+      } else if (op < 0xc0) {
+        uint8_t r = reader_.Next();
+        uint8_t g = reader_.Next();
+        uint8_t b = reader_.Next();
+        for (uint8_t n = (op & 0x3f) + 1; n > 0; n--, pixel++) {
+          if (pixel < limit) {
+            strip->setPixelColor(pixel, r, g, b);
+          }
+        }
+      } else {
+        pixel += (op & 0x3f) + 1;
+      }
+    }
+    frame_++;
+  };
+
+private:
+  Reader reader_;
+  uint16_t pixels_;
+  uint16_t frames_;
+  uint8_t frame_ms_;
+  uint16_t frame_;
+  bool valid_;
+};
+
+#endif  // DSTRAND_ANIM_CODEC_H
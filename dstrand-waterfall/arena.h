@@ -0,0 +1,54 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Host-only bump allocator.  main() reserves one block sized from the
+// strip geometry before anything is built, and every buffer whose size
+// depends on the geometry is carved out of it, so running the effects
+// never allocates.  Nothing is freed before exit.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+class Arena {
+public:
+  Arena():
+    base_(NULL), size_(0), used_(0) {};
+
+  bool Reserve(size_t bytes) {
+    base_ = (char*)malloc(bytes);
+    size_ = base_ != NULL ? bytes : 0;
+    used_ = 0;
+    return base_ != NULL;
+  };
+
+  // Running out means the sizing in main() missed a buffer; that's a bug,
+  // not something to recover from.
+  void* Alloc(size_t bytes) {
+    size_t start = (used_ + kAlign - 1) & ~(kAlign - 1);
+    if (start + bytes > size_) {
+      fprintf(stderr, "arena: %zu bytes wanted, %zu of %zu left\n", bytes,
+              size_ - used_, size_);
+      abort();
+    }
+    used_ = start + bytes;
+    return base_ + start;
+  };
+
+  size_t used() {
+    return used_;
+  };
+
+  size_t size() {
+    return size_;
+  };
+
+  static const size_t kAlign = 16;
+
+private:
+  char* base_;
+  size_t size_;
+  size_t used_;
+};
+
+#endif  // ARENA_H
@@ -0,0 +1,189 @@
+#ifndef DSTRAND_AUDIO_H
+#define DSTRAND_AUDIO_H
+
+// Sound analysis for audio-reactive effects: a fixed-point FFT of one
+// frame's worth of samples, boiled down to kAudioBands band levels of
+// 0..255 that effects can use to drive their parameters.
+//
+// A frame is kAudioFftSize samples at kAudioSampleRate, so each FFT bin
+// is 125 Hz wide and the top bin is 4 kHz, which is as far as the Uno's
+// ADC gets with analogRead().  Samples are signed and at most 16384 in
+// size: with every stage halving, the butterflies then stay inside 16
+// bits, and the whole transform is 16x16 bit multiplies.  The twiddles
+// come from a sine table in flash.
+//
+// Levels rise at once and fall back by an eighth per frame, and are
+// relative to the loudest band heard recently, so quiet and loud rooms
+// both use the full range.
+//
+// On the Uno the analysis and a rainbowCycle() frame have to fit in a 33
+// ms frame along with the 8 ms capture.  Whether they do is unverified:
+// avr-bench's rainbowCycle+audio/frame fails the run if they don't, but
+// it hasn't been run under simavr yet, and tools/audio-bench only times
+// the analysis on the host.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <avr/pgmspace.h>
+#else
+#  ifndef PROGMEM
+#    define PROGMEM
+#  endif
+#  ifndef pgm_read_word
+#    define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#  endif
+#endif
+
+#define kAudioFftBits 6
+#define kAudioFftSize (1 << kAudioFftBits)
+#define kAudioSampleRate 8000
+#define kAudioBands 8
+
+// sin(2 pi i / 64) in Q15, for i up to 3/4 of a turn so cosines can be
+// read from the same table.
+const int16_t kAudioSin[kAudioFftSize * 3 / 4] PROGMEM = {
+       0,   3212,   6393,   9512,  12539,  15446,  18204,  20787,
+   23170,  25329,  27245,  28898,  30273,  31356,  32137,  32609,
+   32767,  32609,  32137,  31356,  30273,  28898,  27245,  25329,
+   23170,  20787,  18204,  15446,  12539,   9512,   6393,   3212,
+       0,  -3212,  -6393,  -9512, -12539, -15446, -18204, -20787,
+  -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+};
+
+// The first FFT bin of each band, and one past the last one of the top
+// band.  Bin 0 is the DC offset, which isn't sound.
+const uint8_t kAudioBandStart[kAudioBands + 1] = {
+  1, 2, 3, 5, 8, 12, 18, 25, 32
+};
+
+inline int16_t AudioSin(uint8_t i) {
+  return pgm_read_word(kAudioSin + i);
+}
+
+inline int16_t AudioCos(uint8_t i) {
+  return pgm_read_word(kAudioSin + i + kAudioFftSize / 4);
+}
+
+// In-place radix-2 FFT of kAudioFftSize points, scaled by
+// 1 / kAudioFftSize.  Inputs must be within +-16384.
+inline void AudioFft(int16_t* re, int16_t* im) {
+  // Bit-reversed order, so the butterflies can work in place.
+  for (uint8_t i = 1, j = 0; i < kAudioFftSize; i++) {
+    uint8_t bit = kAudioFftSize >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+  for (uint8_t len = 2, step = kAudioFftSize / 2; len <= kAudioFftSize;
+       len <<= 1, step >>= 1) {
+    uint8_t half = len >> 1;
+    for (uint8_t k = 0; k < half; k++) {
+      // e^(-2 pi i k / len)
+      int16_t wr = AudioCos(k * step);
+      int16_t wi = -AudioSin(k * step);
+      for (uint8_t i = k; i < kAudioFftSize; i += len) {
+        uint8_t j = i + half;
+        int16_t tr = ((int32_t)wr * re[j] - (int32_t)wi * im[j]) >> 15;
+        int16_t ti = ((int32_t)wr * im[j] + (int32_t)wi * re[j]) >> 15;
+        re[j] = (re[i] - tr) >> 1;
+        im[j] = (im[i] - ti) >> 1;
+        re[i] = (re[i] + tr) >> 1;
+        im[i] = (im[i] + ti) >> 1;
+      }
+    }
+  }
+}
+
+// |re + i im| to within about 12%, without a square root.
+inline uint16_t AudioMagnitude(int16_t re, int16_t im) {
+  uint16_t a = re < 0 ? -re : re;
+  uint16_t b = im < 0 ? -im : im;
+  return a > b ? a + (b >> 1) : b + (a >> 1);
+}
+
+class AudioAnalyzer {
+public:
+  AudioAnalyzer():
+    peak_(kAudioQuiet) {
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      levels_[band] = 0;
+    }
+  };
+
+  // Updates the levels from one frame of samples.  `samples` is used as
+  // the FFT's real part, so it's overwritten.
+  void Analyze(int16_t* samples) {
+    int16_t im[kAudioFftSize];
+    for (uint8_t i = 0; i < kAudioFftSize; i++) {
+      im[i] = 0;
+    }
+    AudioFft(samples, im);
+
+    uint32_t energy[kAudioBands];
+    uint32_t loudest = 0;
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      energy[band] = 0;
+      for (uint8_t bin = kAudioBandStart[band];
+           bin < kAudioBandStart[band + 1]; bin++) {
+        energy[band] += AudioMagnitude(samples[bin], im[bin]);
+      }
+      if (energy[band] > loudest) {
+        loudest = energy[band];
+      }
+    }
+
+    // The reference drifts down by 1/64 per frame, about two seconds at
+    // 30 fps to halve, and jumps up to anything louder.
+    peak_ -= peak_ >> 6;
+    if (peak_ < kAudioQuiet) {
+      peak_ = kAudioQuiet;
+    }
+    if (loudest > peak_) {
+      peak_ = loudest;
+    }
+
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      uint8_t level = energy[band] * 255 / peak_;
+      uint8_t fallen = levels_[band] - (levels_[band] >> 3);
+      levels_[band] = level > fallen ? level : fallen;
+    }
+  };
+
+  uint8_t level(uint8_t band) {
+    return levels_[band];
+  };
+
+  // The bottom two bands, 125-375 Hz.
+  uint8_t bass() {
+    return levels_[0] > levels_[1] ? levels_[0] : levels_[1];
+  };
+
+  // The mean over all bands.
+  uint8_t overall() {
+    uint16_t sum = 0;
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      sum += levels_[band];
+    }
+    return sum / kAudioBands;
+  };
+
+private:
+  // Below this much energy in every band it's silence, and the levels
+  // stay low rather than amplifying the noise floor.
+  static const uint32_t kAudioQuiet = 256;
+
+  uint8_t levels_[kAudioBands];
+  uint32_t peak_;
+};
+
+#endif  // DSTRAND_AUDIO_H
@@ -1,33 +1,78 @@
 #ifdef ARDUINO
-#  include "LPD8806.h"
-#  include "SPI.h" // Comment out this line if using Trinket or Gemma
+#  include "lpd8806_spi.h"
 #  ifdef __AVR_ATtiny85__
 #    include <avr/power.h>
 #  endif
 #else
+#  include <stdio.h>
+#  include <stdlib.h>
+#  include <string.h>
 #  include <unistd.h>
 #  include <curses.h>
 #  include <iostream>
+#  include <condition_variable>
+#  include <mutex>
+#  include <thread>
+#  include "arena.h"
+#  include "frame_pacer.h"
+#  include "wav.h"
 #endif
 
 #include <stdint.h>
 
+#include "anim_codec.h"
+#include "audio.h"
+#include "compositor.h"
+#include "noise.h"
+#include "particles.h"
+#include "power_budget.h"
+
 typedef uint8_t byte;
 
 // Example to control LPD8806-based RGB LED Modules in a strip
 
 /*****************************************************************************/
 
-// Number of RGB LEDs in strand:
+// Number of RGB LEDs in strand (the host build can change both; see
+// main()):
 #define nLEDS 22
 #define nSTRIPS 8
 #define kSwapBlueGreen true
 #define kStripScale 1
 
+// What the strip's supply can give, in mA; frames estimated to draw more
+// are dimmed to fit (see power_budget.h).  The host's -W changes it.
+#define kPowerBudgetMa 4000
+
 
-// Chose 2 pins for output; can be any valid output pins:
+// The strands' data and clock pins.  On the Uno they're the SPI port's
+// MOSI and SCK, 11 and 13, so show() only starts the frame and the next
+// one renders while it goes out; strands wired to 2 and 3 for earlier
+// versions of this sketch need moving.  The Trinket has no SPI port and
+// bit-bangs on 2 and 3, so there rendering and sending take turns.
+#ifdef __AVR_ATtiny85__
 int dataPin  = 2;
 int clockPin = 3;
+#else
+int dataPin  = 11;
+int clockPin = 13;
+#endif
+
+
+// Buffers sized by the strip geometry.  On the board they come from the
+// heap, once, in setup(); the host build carves them out of an arena
+// reserved in main() so nothing is allocated per frame.
+#ifdef ARDUINO
+void* StripAlloc(size_t bytes) {
+  return malloc(bytes);
+}
+#else
+Arena arena;
+
+void* StripAlloc(size_t bytes) {
+  return arena.Alloc(bytes);
+}
+#endif
 
 
 byte MoveToTarget(byte current, byte target, byte step) {
@@ -216,117 +261,681 @@ private:
 };
 
 
+// One period of an effect whose frames only rotate, such as the wheel
+// cycles: frame j + 1 is frame j moved one step along the period.  The
+// period is rendered once, then each frame only moves the head, and the
+// strip looks its pixels up from there (see Strip::setPattern()).
+//
+// The ring takes 3 bytes per step, allocated for the longest period
+// (1152 bytes for the rainbow wheel) on the first Render().  That's more
+// than half an Uno's RAM, and rendering a wheel color costs little next
+// to sending it, so boards with under 4 KB don't have a ring, and their
+// strips leave out the pattern lookup altogether (see ShowPattern()).
+// If the ring can't be allocated or the period is too long for it, At()
+// renders each color as it's asked for, which shows the same frames.
+#if defined(RAMEND) && RAMEND < 0x1000
+#  define kPatternMaxPeriod 0
+#else
+#  define kPatternMaxPeriod 384
+#endif
+
+class CyclicPattern {
+public:
+  CyclicPattern():
+    render_(NULL), period_(0), head_(0), ring_(NULL) {};
+
+  // Fills the ring with render(0) .. render(period - 1) and rewinds.  A
+  // repeat of the last render only rewinds.
+  void Render(uint16_t period, Color (*render)(uint16_t)) {
+    head_ = 0;
+    if (render == render_ && period == period_) {
+      return;
+    }
+    if (ring_ == NULL && kPatternMaxPeriod > 0) {
+      ring_ = (byte (*)[3])StripAlloc(kPatternMaxPeriod * 3);
+    }
+    render_ = render;
+    period_ = period;
+    if (!rendered()) {
+      return;
+    }
+    for (uint16_t step = 0; step < period; step++) {
+      Color color = render(step);
+      ring_[step][0] = color.GetRed();
+      ring_[step][1] = color.GetGreen();
+      ring_[step][2] = color.GetBlue();
+    }
+  };
+
+  uint16_t period() {
+    return period_;
+  };
+
+  void Advance() {
+    if (++head_ == period_) {
+      head_ = 0;
+    }
+  };
+
+  // The color `step` (< period) past the head.
+  Color At(uint16_t step) {
+    uint16_t pos = head_ + step;
+    if (pos >= period_) {
+      pos -= period_;
+    }
+    if (!rendered()) {
+      return render_(pos);
+    }
+    return Color(ring_[pos][0], ring_[pos][1], ring_[pos][2]);
+  };
+
+  // Whether the period is in the ring, rather than rendered per frame.
+  bool rendered() {
+    return ring_ != NULL && period_ <= kPatternMaxPeriod;
+  };
+
+private:
+  Color (*render_)(uint16_t);
+  uint16_t period_;
+  uint16_t head_;
+  byte (*ring_)[3];
+};
+
+// Effects draw into pixels_, the back buffer.  show() copies it into the
+// output's front buffer and starts sending that, so the next frame can be
+// drawn while this one goes out (on the board, only over hardware SPI;
+// see dataPin); it only blocks if the previous frame is still being
+// sent.  pixels_ keeps the frame just shown, which delta
+// frames and StepColor() build on.
+//
+// Color and its tuple are plain data, so the buffers are just assigned.
 class Strip {
 public:
-  Strip(byte size):
-  size_(size) {
+  Strip(uint16_t size):
+  size_(size),
+  pixels_((class Color*)StripAlloc(size * sizeof(class Color))),
+  brightness_(255),
+  scale_(255),
+#if kPatternMaxPeriod > 0
+  pattern_(NULL),
+  offsets_((uint16_t*)StripAlloc(size * sizeof(uint16_t))),
+#endif
+  load_(0),
+  power_(kPowerLpd8806) {
     for (int i = 0; i < size; i++) {
       pixels_[i] = Color(sequence.GetNextColor(i));
       pixels_[i].SetTarget(i + 1);
+      load_ += Load(pixels_[i]);
     }
   };
 
-  byte numPixels() {
+  virtual ~Strip() {};
+
+  uint16_t numPixels() {
     return size_;
   };
 
-  void setPixelColor(const byte& pixel, const class Color& color) {
-    pixels_[pixel] = color;
+  // What the buffers for `size` pixels take from StripAlloc().
+  static size_t AllocBytes(uint16_t size) {
+#if kPatternMaxPeriod > 0
+    return size * (sizeof(class Color) + sizeof(uint16_t));
+#else
+    return size * sizeof(class Color);
+#endif
+  };
+
+  void setPixelColor(uint16_t pixel, const class Color& color) {
+    Put(pixel, color);
+  };
+
+  void setPixelColor(uint16_t pixel, byte red, byte green, byte blue) {
+    Put(pixel, Color(red, green, blue));
+  };
+
+  // Adds to what's there, for effects drawn over others.  Channels
+  // saturate at 127, all the LPD8806 takes.
+  void addPixelColor(uint16_t pixel, byte red, byte green, byte blue) {
+    class Color& color = pixels_[pixel];
+    Put(pixel, Color(AddChannel(color.GetRed(), red),
+                     AddChannel(color.GetGreen(), green),
+                     AddChannel(color.GetBlue(), blue)));
   };
 
-  void StepColor(const byte& pixel) {
+  // Scales every pixel by keep / 255, leaving trails behind whatever
+  // moves.
+  void fadePixels(byte keep) {
+    uint16_t w = BlendWeight(keep);
+    for (int i = 0; i < size_; i++) {
+      class Color& color = pixels_[i];
+      Put(i, Color((color.GetRed() * w) >> 8, (color.GetGreen() * w) >> 8,
+                   (color.GetBlue() * w) >> 8));
+    }
+  };
+
+  void StepColor(uint16_t pixel) {
+    load_ -= Load(pixels_[pixel]);
     pixels_[pixel].StepColor();
+    load_ += Load(pixels_[pixel]);
   }
 
+#if kPatternMaxPeriod > 0
+  // Until cleared with NULL, every show() takes pixel i from `pattern`,
+  // i * period / numPixels() steps past its head, in place of whatever
+  // was set with setPixelColor().
+  void setPattern(CyclicPattern* pattern) {
+    pattern_ = pattern;
+    if (pattern != NULL) {
+      for (int i = 0; i < size_; i++) {
+        offsets_[i] = (uint32_t)i * pattern->period() / size_;
+      }
+    }
+  };
+#endif
+
+
+  // Scales what show() sends, 255 being as set; pixels_ keeps the
+  // unscaled colors.
+  void setBrightness(byte brightness) {
+    brightness_ = brightness;
+  };
+
+  // `copies` strands of this strip from a supply that gives `milliamps`.
+  void setPowerLimit(uint8_t copies, uint16_t milliamps) {
+    power_.SetLimit(size_, copies, milliamps);
+  };
+
+  PowerBudget& power() {
+    return power_;
+  };
 
   virtual void begin() = 0;
   virtual void show() = 0;
 
+  // Blocks until the last shown frame is completely out.
+  virtual void waitForShow() {};
+
 protected:
-  byte size_;
-  class Color pixels_[nLEDS];
+  static byte AddChannel(byte value, byte add) {
+    return value + add < 127 ? value + add : 127;
+  };
+
+  // Called first thing by show(): takes the frame from the pattern, if
+  // there is one, and works out its scale.
+  void PrepareFrame() {
+#if kPatternMaxPeriod > 0
+    if (pattern_ != NULL) {
+      for (int i = 0; i < size_; i++) {
+        Put(i, pattern_->At(offsets_[i]));
+      }
+    }
+#endif
+    uint8_t limit = power_.Frame(load_ * kStripScale, brightness_);
+    scale_ = (brightness_ * BlendWeight(limit)) >> 8;
+  };
+
+  // Pixel `pixel` as it should go out.
+  class Color Shown(uint16_t pixel) {
+    if (scale_ == 255) {
+      return pixels_[pixel];
+    }
+    uint16_t w = BlendWeight(scale_);
+    return Color((pixels_[pixel].GetRed() * w) >> 8,
+                 (pixels_[pixel].GetGreen() * w) >> 8,
+                 (pixels_[pixel].GetBlue() * w) >> 8);
+  };
+
+  uint16_t size_;
+  class Color* pixels_;
+  byte brightness_;
+  byte scale_;  // brightness_, dimmed to the power budget.
+#if kPatternMaxPeriod > 0
+  CyclicPattern* pattern_;
+  uint16_t* offsets_;
+#endif
+  uint32_t load_;  // Sum of every pixel's channels.
+  PowerBudget power_;
+
+private:
+  static uint16_t Load(class Color& color) {
+    return color.GetRed() + color.GetGreen() + color.GetBlue();
+  };
+
+  // Every change to pixels_ goes through here (or StepColor()), so
+  // load_ stays current.
+  void Put(uint16_t pixel, const class Color& color) {
+    load_ -= Load(pixels_[pixel]);
+    pixels_[pixel] = color;
+    load_ += Load(pixels_[pixel]);
+  };
 
 };
 
 #ifdef ARDUINO
 class ArduinoStrip: public Strip {
 public:
-  ArduinoStrip(byte size):
-    Strip(size) {
-    strip_ = LPD8806(nLEDS * nSTRIPS, dataPin, clockPin);
-
+  ArduinoStrip(uint16_t size):
+    Strip(size),
+    strip_(nLEDS, nSTRIPS, dataPin, clockPin) {
   };
 
   virtual void begin() {
     strip_.begin();
   };
 
+  // The driver's wire buffer is the front buffer.
   virtual void show() {
+    PrepareFrame();
+    strip_.waitForShow();
     for (unsigned int i = 0; i < size_; i++) {
       SetPixelColor(i);
     }
     strip_.show();
   };
 
+  virtual void waitForShow() {
+    strip_.waitForShow();
+  };
+
 private:
   void SetPixelColor(short pixel) {
-    for (int i = 0; i < nSTRIPS; i++) {
-      byte red = pixels_[pixel].GetRed() * kStripScale;
-      byte blue = pixels_[pixel].GetBlue() * kStripScale;
-      byte green = pixels_[pixel].GetGreen() * kStripScale;
-
-      if (kSwapBlueGreen) {
-        strip_.setPixelColor(pixel + (nLEDS * i),
-                             strip_.Color(red, blue, green));
-      } else {
-        strip_.setPixelColor(pixel + (nLEDS * i),
-                             strip_.Color(red, green, blue));
-      }
+    class Color shown = Shown(pixel);
+    byte red = shown.GetRed() * kStripScale;
+    byte blue = shown.GetBlue() * kStripScale;
+    byte green = shown.GetGreen() * kStripScale;
+
+    if (kSwapBlueGreen) {
+      strip_.setPixelColor(pixel, red, blue, green);
+    } else {
+      strip_.setPixelColor(pixel, red, green, blue);
     }
   };
 
-  // First parameter is the number of LEDs in the strand.  The LED strips
-  // are 32 LEDs per meter but you can extend or cut the strip.  Next two
-  // parameters are SPI data and clock pins:
-  LPD8806 strip_;
+  // First parameter is the number of LEDs in one strand; the driver sends
+  // it nSTRIPS times.  Next two parameters are the data and clock pins.
+  Lpd8806Spi strip_;
   
 };
 
 #else
 
-class NcursesStrip: public Strip {
+// Stands in for the board's clock; see main().
+FramePacer pacer;
+
+// Where each physical pixel sits in the installation.  Physical pixel p
+// is logical pixel p % pixels on strand p / pixels, and every strand is a
+// row, as ArduinoStrip wires them.
+struct StripLayout {
+  uint16_t pixels;  // Per strand.
+  uint8_t copies;   // Strands.
+  bool serpentine;  // Odd strands run the other way.
+  bool mirrored;    // Strand 0 starts on the right.
+
+  uint16_t physicalPixels() const {
+    return pixels * copies;
+  };
+
+  void Position(uint16_t physical, int* row, int* col) const {
+    *row = physical / pixels;
+    *col = physical % pixels;
+    if (Reversed(*row)) {
+      *col = pixels - 1 - *col;
+    }
+  };
+
+  // The inverse of Position().
+  uint16_t Physical(int row, int col) const {
+    if (Reversed(row)) {
+      col = pixels - 1 - col;
+    }
+    return row * pixels + col;
+  };
+
+  bool Reversed(int row) const {
+    return (serpentine && (row & 1)) != mirrored;
+  };
+};
+
+// Set by -S and -M.
+StripLayout layout = {nLEDS, nSTRIPS, false, false};
+
+// Set by -T, or when curses can't change colors.
+bool truecolor = false;
+
+// Sends frames from an output thread, standing in for the SPI interrupt.
+// Subclasses implement Draw() and must call Stop() in their destructor,
+// so the thread is gone before they are.
+class ThreadedStrip: public Strip {
 public:
-  NcursesStrip(byte size):
-    Strip(size)
+  ThreadedStrip(uint16_t size):
+    Strip(size),
+    front_((class Color*)StripAlloc(size * sizeof(class Color))),
+    pending_(false),
+    stop_(false)
   {};
 
-  virtual void begin() {};
+  virtual ~ThreadedStrip() {
+    Stop();
+  };
+
+  virtual void begin() {
+    output_ = std::thread(&ThreadedStrip::Output, this);
+  };
+
+  static size_t AllocBytes(uint16_t size) {
+    return Strip::AllocBytes(size) + size * sizeof(class Color);
+  };
 
   virtual void show() {
+    PrepareFrame();
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !pending_; });
     for (unsigned int i = 0; i < size_; i++) {
-      SetPixelColor(i);
-      
+      front_[i] = Shown(i);
     }
-    wrefresh(stdscr);
+    pacer.FrameShown();
+    pending_ = true;
+    changed_.notify_all();
   };
+
+  virtual void waitForShow() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !pending_; });
+  };
+
+protected:
+  // Called on the output thread with the frame to send.
+  virtual void Draw(const class Color* frame) = 0;
+
+  // Returns once the last frame is drawn.
+  void Stop() {
+    if (!output_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    output_.join();
+  };
+
 private:
-  void SetPixelColor(short pixel) {
-    unsigned int pair = pixel + 32; // static offset.
+  void Output() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      changed_.wait(lock, [this] { return pending_ || stop_; });
+      if (!pending_) {
+        return;
+      }
+      // show() won't touch front_ while pending_ is set.
+      lock.unlock();
+      Draw(front_);
+      lock.lock();
+      pending_ = false;
+      changed_.notify_all();
+    }
+  };
+
+  class Color* front_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool pending_;
+  bool stop_;
+  std::thread output_;
+};
+
+// Only the output thread touches curses until the strip is deleted.
+//
+// Every physical pixel gets a cell, but all copies of a logical pixel share
+// one color pair, so after the first frame only changed colors are sent
+// and the cells themselves never need redrawing.
+class NcursesStrip: public ThreadedStrip {
+public:
+  NcursesStrip(uint16_t size, const StripLayout& layout):
+    ThreadedStrip(size),
+    layout_(layout),
+    drawn_(false),
+    shown_((class Color*)StripAlloc(size * sizeof(class Color)))
+  {};
+
+  static size_t AllocBytes(const StripLayout& layout) {
+    return ThreadedStrip::AllocBytes(layout.pixels)
+        + layout.pixels * sizeof(class Color);
+  };
+
+  // Colors and pairs below this are left to curses.
+  static const unsigned int kPairBase = 32;
+
+  // The screen's own pair, after the pixels' kPairBase + pixel.
+  static unsigned int BackgroundPair(const StripLayout& layout) {
+    return kPairBase + layout.pixels;
+  };
+
+  virtual ~NcursesStrip() {
+    Stop();
+  };
+
+protected:
+  // Everything goes out in the one doupdate().
+  virtual void Draw(const class Color* frame) {
+    for (unsigned int i = 0; i < size_; i++) {
+      SetPixelColor(i, frame[i]);
+    }
+    if (!drawn_) {
+      for (uint16_t p = 0; p < layout_.physicalPixels(); p++) {
+        int row, col;
+        layout_.Position(p, &row, &col);
+        mvwaddch(stdscr, 5 + row, 10 + col,
+                 '#' | COLOR_PAIR(kPairBase + p % layout_.pixels));
+      }
+      drawn_ = true;
+    }
+    wnoutrefresh(stdscr);
+    doupdate();
+  };
+
+private:
+  void SetPixelColor(short pixel, class Color color) {
+    unsigned int pair = pixel + kPairBase;
     
-    byte red = pixels_[pixel].GetRed();
-    byte green = pixels_[pixel].GetGreen();
-    byte blue = pixels_[pixel].GetBlue();
+    byte red = color.GetRed();
+    byte green = color.GetGreen();
+    byte blue = color.GetBlue();
+
+    if (drawn_ && red == shown_[pixel].GetRed()
+        && green == shown_[pixel].GetGreen()
+        && blue == shown_[pixel].GetBlue()) {
+      return;
+    }
+    shown_[pixel] = color;
     
-    // Create colors starting at 32 (== pair):
+    // Create colors starting at kPairBase (== pair):
     init_color(pair, red * 10, green * 10, blue * 10);
 
     // Assign it to a color pair:
     init_pair(pair, pair, COLOR_BLACK);
+  };
 
-    // Write a character:
-    mvwaddch(stdscr, 5, 10 + pixel, '#' | COLOR_PAIR(pair));
+  StripLayout layout_;
+  bool drawn_;
+  class Color* shown_;  // Only touched by the output thread.
+};
+
+// Writes 24-bit color escapes straight to the terminal, for terminals
+// that can't redefine colors (or have too few of them) and for running
+// over ssh.  Each frame is one write() holding only the cells whose color
+// changed, with the cursor moved only where a run of them breaks and the
+// color only set where it differs from the previous cell's.
+class AnsiStrip: public ThreadedStrip {
+public:
+  AnsiStrip(uint16_t size, const StripLayout& layout):
+    ThreadedStrip(size),
+    layout_(layout),
+    drawn_(false),
+    shown_((uint32_t*)StripAlloc(size * sizeof(uint32_t))),
+    changed_((bool*)StripAlloc(size * sizeof(bool))),
+    out_size_(OutBytes(layout)),
+    out_((char*)StripAlloc(out_size_)),
+    out_len_(0)
+  {};
+
+  virtual ~AnsiStrip() {
+    Stop();
+    // Leave the cursor below the strip, visible and uncolored.
+    out_len_ = 0;
+    MoveTo(kTop + layout_.copies, 0);
+    Append("\x1b[0m\x1b[?25h");
+    Flush();
   };
+
+  static size_t AllocBytes(const StripLayout& layout) {
+    return ThreadedStrip::AllocBytes(layout.pixels)
+        + layout.pixels * (sizeof(uint32_t) + sizeof(bool))
+        + OutBytes(layout);
+  };
+
+protected:
+  virtual void Draw(const class Color* frame) {
+    out_len_ = 0;
+    if (!drawn_) {
+      Append("\x1b[2J\x1b[?25l");
+    }
+    for (unsigned int i = 0; i < size_; i++) {
+      uint32_t rgb = Rgb(frame[i]);
+      changed_[i] = !drawn_ || rgb != shown_[i];
+      shown_[i] = rgb;
+    }
+
+    // Unknown at the start of a frame, so the first cell sets both.
+    int cursor_row = -1;
+    int cursor_col = -1;
+    uint32_t sgr = 0xffffffff;
+    for (int row = 0; row < layout_.copies; row++) {
+      for (int col = 0; col < layout_.pixels; col++) {
+        uint16_t pixel = layout_.Physical(row, col) % layout_.pixels;
+        if (!changed_[pixel]) {
+          continue;
+        }
+        if (row != cursor_row || col != cursor_col) {
+          MoveTo(kTop + row, kLeft + col);
+          cursor_row = row;
+          cursor_col = col;
+        }
+        if (shown_[pixel] != sgr) {
+          sgr = shown_[pixel];
+          Append("\x1b[38;2;");
+          AppendNumber(sgr >> 16);
+          Append(";");
+          AppendNumber((sgr >> 8) & 0xff);
+          Append(";");
+          AppendNumber(sgr & 0xff);
+          Append("m");
+        }
+        Append("#");
+        cursor_col++;
+      }
+    }
+    drawn_ = true;
+    Flush();
+  };
+
+private:
+  // Same scale as the curses colors: 100 is full brightness.
+  static uint32_t Rgb(class Color color) {
+    return (Scale(color.GetRed()) << 16) | (Scale(color.GetGreen()) << 8)
+        | Scale(color.GetBlue());
+  };
+
+  static uint32_t Scale(byte value) {
+    return value >= 100 ? 255 : value * 255 / 100;
+  };
+
+  // Worst case, every cell needs a cursor move (up to 14 bytes), a color
+  // (up to 19) and its character, plus the setup and teardown sequences.
+  static size_t OutBytes(const StripLayout& layout) {
+    return layout.physicalPixels() * 34 + 64;
+  };
+
+  void MoveTo(int row, int col) {
+    Append("\x1b[");
+    AppendNumber(row + 1);
+    Append(";");
+    AppendNumber(col + 1);
+    Append("H");
+  };
+
+  void AppendNumber(unsigned int n) {
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%u", n);
+    Append(digits);
+  };
+
+  void Append(const char* s) {
+    while (*s != '\0' && out_len_ < out_size_) {
+      out_[out_len_++] = *s++;
+    }
+  };
+
+  void Flush() {
+    const char* p = out_;
+    size_t left = out_len_;
+    while (left > 0) {
+      ssize_t n = write(STDOUT_FILENO, p, left);
+      if (n <= 0) {
+        return;
+      }
+      p += n;
+      left -= n;
+    }
+  };
+
+  static const int kTop = 5;
+  static const int kLeft = 10;
+
+  StripLayout layout_;
+  bool drawn_;
+  uint32_t* shown_;
+  bool* changed_;
+  size_t out_size_;
+  char* out_;
+  size_t out_len_;
 };
+
+// Writes every shown frame as raw r, g, b bytes, for tools/bake-animation.
+class FrameDumpStrip: public Strip {
+public:
+  FrameDumpStrip(uint16_t size, FILE* out):
+    Strip(size), out_(out)
+  {};
+
+  virtual void begin() {};
+
+  virtual void show() {
+    PrepareFrame();
+    for (unsigned int i = 0; i < size_; i++) {
+      class Color shown = Shown(i);
+      byte rgb[3] = {shown.GetRed(), shown.GetGreen(), shown.GetBlue()};
+      fwrite(rgb, 1, sizeof(rgb), out_);
+    }
+    pacer.FrameShown();
+  };
+
+private:
+  FILE* out_;
+};
+
+// Set by -r; when non-NULL frames go there instead of the terminal.
+FILE* frameDump = NULL;
+
+// Set by -W.
+uint16_t powerBudgetMa = kPowerBudgetMa;
+
+void ReportPower(PowerBudget& power, FILE* out) {
+  fprintf(out, "power: peak %u mA, average %u mA; %lu of %lu frames "
+          "dimmed to %u mA\n", power.peakMilliamps(),
+          power.averageMilliamps(), (unsigned long)power.limited(),
+          (unsigned long)power.frames(), powerBudgetMa);
+}
 #endif
 
 Strip *mystrip = NULL;
@@ -356,11 +965,17 @@ byte current_r, current_g, current_b = 0;
 byte target_r, target_g, target_b = 0;
 byte step_r, step_g, step_b = 0;
 
-Strip* CreateStrip(byte num_leds) {
+Strip* CreateStrip(uint16_t num_leds) {
 # ifdef ARDUINO
   return new ArduinoStrip(num_leds);
 # else
-  return new NcursesStrip(num_leds);
+  if (frameDump != NULL) {
+    return new FrameDumpStrip(num_leds, frameDump);
+  }
+  if (truecolor) {
+    return new AnsiStrip(num_leds, layout);
+  }
+  return new NcursesStrip(num_leds, layout);
 # endif
 }
 
@@ -369,7 +984,13 @@ void setup() {
   clock_prescale_set(clock_div_1); // Enable 16 MHz on Trinket
 #endif
   
+#ifdef ARDUINO
   mystrip = CreateStrip(nLEDS);
+  mystrip->setPowerLimit(nSTRIPS, kPowerBudgetMa);
+#else
+  mystrip = CreateStrip(layout.pixels);
+  mystrip->setPowerLimit(layout.copies, powerBudgetMa);
+#endif
 
   // Start up the LED strip
   mystrip->begin();
@@ -382,10 +1003,11 @@ void setup() {
 
 #ifndef ARDUINO
 long millis() {
-  static long now = 0;
-  long ret = now;
-  now += strip_interval;
-  return ret;
+  return pacer.Micros() / 1000;
+}
+
+void delay(unsigned long ms) {
+  pacer.Wait(ms * 1000);
 }
 #endif
 
@@ -422,22 +1044,120 @@ Color Wheel(uint16_t WheelPos)
   return(Color(ColorTuple(r,g,b)));
 }
 
+// Sound for the audio-reactive effects.  On the board, build with
+// -DAUDIO_INPUT=A0 (or whichever analog pin the microphone amplifier is
+// on); the host reads a WAV file given with -A.
+AudioAnalyzer audio;
+
+#ifdef ARDUINO
+#  ifdef AUDIO_INPUT
+bool audioActive = true;
+
+// Reads one frame of samples at kAudioSampleRate; about 8 ms.
+void AudioCapture(int16_t* samples) {
+  unsigned long next = micros();
+  for (uint8_t i = 0; i < kAudioFftSize; i++) {
+    while ((long)(micros() - next) < 0) {
+    }
+    next += 1000000UL / kAudioSampleRate;
+    samples[i] = (analogRead(AUDIO_INPUT) - 512) << 5;
+  }
+}
+#  else
+bool audioActive = false;
+
+void AudioCapture(int16_t* samples) {}
+#  endif
+#else
+bool audioActive = false;
+WavSource wav;
+
+// The frame of the file that ends at the current time, so a dump follows
+// the sound the same way on every run.
+void AudioCapture(int16_t* samples) {
+  int64_t end = pacer.Micros() * kAudioSampleRate / 1000000;
+  for (int i = 0; i < kAudioFftSize; i++) {
+    samples[i] = wav.At(end - kAudioFftSize + i);
+  }
+}
+#endif
+
+void AudioUpdate() {
+  int16_t samples[kAudioFftSize];
+  AudioCapture(samples);
+  audio.Analyze(samples);
+}
+
+// The wheel cycles only rotate, so each renders its wheel once and then
+// just moves the head.
+CyclicPattern wheelPattern;
+
+// Shows wheelPattern from its head, between StartPattern() and
+// StopPattern().  With the ring the strip looks each pixel up in it as
+// it's shown; without one, each pixel's color is rendered straight into
+// the strip first, as the cycles did before the ring.
+void StartPattern(uint16_t period, Color (*render)(uint16_t)) {
+  wheelPattern.Render(period, render);
+#if kPatternMaxPeriod > 0
+  mystrip->setPattern(&wheelPattern);
+#endif
+}
+
+void ShowPattern() {
+#if kPatternMaxPeriod == 0
+  // Pixel i is i * period / pixels along, stepped without a divide each.
+  uint16_t pixels = mystrip->numPixels();
+  uint16_t step = wheelPattern.period() / pixels;
+  uint16_t extra = wheelPattern.period() % pixels;
+  uint16_t offset = 0;
+  uint16_t rest = 0;
+  for (uint16_t i = 0; i < pixels; i++) {
+    mystrip->setPixelColor(i, wheelPattern.At(offset));
+    offset += step;
+    rest += extra;
+    if (rest >= pixels) {
+      rest -= pixels;
+      offset++;
+    }
+  }
+#endif
+  mystrip->show();
+}
+
+void StopPattern() {
+#if kPatternMaxPeriod > 0
+  mystrip->setPattern(NULL);
+#endif
+}
+
+// Where noiseCycle() is in the field's z axis; kept across calls so the
+// field carries on moving rather than jumping back.
+uint16_t noiseZ = 0;
+
 // Slightly different, this one makes the rainbow wheel equally distributed 
 // along the chain
 void rainbowCycle() {
-  uint16_t i, j;
+  uint16_t j;
+  // Each pixel sits at its fraction of the full 384-color wheel (the
+  // i * 384 / numPixels() offsets ShowPattern() uses), and advancing the
+  // head by j makes the colors go around.
+  // With sound, the bass pushes the wheel round faster and the overall
+  // level sets the brightness.
+  StartPattern(384, Wheel);
   for (j=0; j < 384; j++) {     // 5 cycles of all 384 colors in the wheel
-
-    for (i=0; i < mystrip->numPixels(); i++) {
-      // tricky math! we use each pixel as a fraction of the full 384-color wheel
-      // (thats the i / strip.numPixels() part)
-      // Then add in j which makes the colors go around per pixel
-      // the % 384 is to make the wheel cycle around
-      mystrip->setPixelColor(i, Wheel( ((i * 384 / mystrip->numPixels()) + j) % 384) );
-    }  
-    mystrip->show();   // write all the pixels out
+    if (audioActive) {
+      AudioUpdate();
+      for (byte extra = audio.bass() >> 5; extra > 0; extra--) {
+        wheelPattern.Advance();
+      }
+      mystrip->setBrightness(64 + audio.overall() * 3 / 4);
+    }
+    ShowPattern();   // write all the pixels out
+    wheelPattern.Advance();
     delay(1);
   }
+  StopPattern();
+  mystrip->setBrightness(255);
 }
 
 Color RedYellowWheel(uint16_t WheelPos) {
@@ -459,15 +1179,15 @@ Color RedYellowWheel(uint16_t WheelPos) {
 }
 
 void redYellowCycle() {
-  uint16_t i, j;
+  uint16_t j;
   
+  StartPattern(128, RedYellowWheel);
   for (j=0; j < 128; j++) {
-    for (i=0; i < mystrip->numPixels(); i++) {
-      mystrip->setPixelColor(i, RedYellowWheel(((i * 128 / mystrip->numPixels()) + j) % 128));
-    }
-    mystrip->show();
+    ShowPattern();
+    wheelPattern.Advance();
     delay(4);
   }
+  StopPattern();
 }
 
 Color BlueWheel(uint16_t WheelPos) {
@@ -489,21 +1209,176 @@ Color BlueWheel(uint16_t WheelPos) {
 }
 
 void blueCycle() {
-  uint16_t i, j;
+  uint16_t j;
   
+  StartPattern(128, BlueWheel);
   for (j=0; j < 128; j++) {
-    for (i=0; i < mystrip->numPixels(); i++) {
-      mystrip->setPixelColor(i, BlueWheel(((i * 128 / mystrip->numPixels()) + j) % 128));
+    ShowPattern();
+    wheelPattern.Advance();
+    delay(4);
+  }
+  StopPattern();
+}
+
+// Noise steps between neighbouring pixels and between frames, in the 8.8
+// units of noise.h: about three lattice cells along the strand, drifting
+// through a cell every ~50 frames.
+#define kNoiseScale 40
+#define kNoiseSpeed 5
+#define kNoiseChunk 32
+
+// Each pixel takes its wheel color from a 3D noise field sampled along
+// the strand, with the line drifting in y and z so blobs of color swell,
+// merge and wander.  The field is computed a chunk of pixels at a time;
+// at 33 ms a frame this is the 30 fps the field is sized for.
+void noiseCycle() {
+  uint8_t values[kNoiseChunk];
+  uint16_t pixels = mystrip->numPixels();
+  for (uint16_t j = 0; j < 128; j++) {
+    for (uint16_t i = 0; i < pixels; i += kNoiseChunk) {
+      uint16_t count = pixels - i < kNoiseChunk ? pixels - i : kNoiseChunk;
+      NoiseRow(i * kNoiseScale, kNoiseScale, j * 2, noiseZ, values, count);
+      for (uint16_t k = 0; k < count; k++) {
+        // The field rarely strays far from the middle, so stretch it over
+        // more of the wheel.
+        mystrip->setPixelColor(i + k,
+                               Wheel((values[k] * 3 / 2 + j) % 384));
+      }
     }
     mystrip->show();
-    delay(4);
+    noiseZ += kNoiseSpeed;
+    delay(33);
+  }
+}
+// layeredCycle()'s layers, and the frame they're composited into; both
+// are allocated the first time it runs.
+#define kLayerWheel 0
+#define kLayerBlue 1
+#define kLayerNoise 2
+#define kLayerCount 3
+Compositor* compositor = NULL;
+byte* composite = NULL;
+
+// Sets up the compositor for `pixels`, if it isn't already.  Returns false
+// if there isn't the RAM for it.
+bool LayersReady(uint16_t pixels) {
+  if (compositor != NULL) {
+    return true;
+  }
+  // One block for the layers and the frame, so a failure leaves nothing
+  // allocated.
+  byte* buffers =
+      (byte*)StripAlloc(Compositor::AllocBytes(pixels, kLayerCount + 1));
+  if (buffers == NULL) {
+    return false;
+  }
+  compositor = new Compositor(pixels, kLayerCount, buffers);
+  if (compositor == NULL) {
+    return false;
+  }
+  composite = buffers + Compositor::AllocBytes(pixels, kLayerCount);
+  compositor->SetBlend(kLayerBlue, kBlendAlpha, 0);
+  compositor->SetBlend(kLayerNoise, kBlendMultiply, 192);
+  return true;
+}
+
+// The rainbow wheel with the blue wheel crossfading in and back out over
+// it, all dimmed in patches by the noise field.  Each effect renders its
+// own layer once per frame and the compositor blends them.  Skipped when
+// there's no RAM for the layers.
+void layeredCycle() {
+  uint16_t pixels = mystrip->numPixels();
+  if (!LayersReady(pixels)) {
+    return;
+  }
+  uint8_t values[kNoiseChunk];
+  for (uint16_t j = 0; j < 256; j++) {
+    for (uint16_t i = 0; i < pixels; i++) {
+      Color wheel = Wheel((i * 384UL / pixels + j) % 384);
+      compositor->SetPixel(kLayerWheel, i, wheel.GetRed(),
+                           wheel.GetGreen(), wheel.GetBlue());
+      Color blue = BlueWheel((i * 128UL / pixels + j) % 128);
+      compositor->SetPixel(kLayerBlue, i, blue.GetRed(), blue.GetGreen(),
+                           blue.GetBlue());
+    }
+    for (uint16_t i = 0; i < pixels; i += kNoiseChunk) {
+      uint16_t count = pixels - i < kNoiseChunk ? pixels - i : kNoiseChunk;
+      NoiseRow(i * kNoiseScale, kNoiseScale, j * 2, noiseZ, values, count);
+      for (uint16_t k = 0; k < count; k++) {
+        // As a multiplier the middle of the field should be full
+        // brightness, not half.
+        byte level = values[k] < 128 ? values[k] * 2 : 255;
+        compositor->SetPixel(kLayerNoise, i + k, level, level, level);
+      }
+    }
+    compositor->SetOpacity(kLayerBlue, j < 128 ? j * 2 : (255 - j) * 2);
+    compositor->Composite(composite);
+    for (uint16_t i = 0; i < pixels; i++) {
+      mystrip->setPixelColor(i, composite[i * 3], composite[i * 3 + 1],
+                             composite[i * 3 + 2]);
+    }
+    mystrip->show();
+    noiseZ += kNoiseSpeed;
+    delay(16);
+  }
+}
+// particleCycle()'s pool; 8 bytes a particle on the board (12 on the
+// host).
+#ifdef __AVR_ATtiny85__
+#  define kParticleCapacity 8
+#else
+#  define kParticleCapacity 24
+#endif
+ParticlePool<kParticleCapacity> particles;
+
+// Sparks that glint and fade, a comet every 96 frames, and a firework
+// burst in between, all over fading trails of the frames before.
+void particleCycle() {
+  uint16_t pixels = mystrip->numPixels();
+  particles.Clear();
+  for (uint16_t j = 0; j < 384; j++) {
+    if (ParticleRandom() % 4 == 0) {
+      particles.Spawn((uint32_t)(ParticleRandom() % pixels) << 8, 0,
+                      8 + ParticleRandom() % 16, 96, 96, 96);
+    }
+    if (j % 96 == 0) {
+      particles.Spawn(0, 160, 255, 127, 64, 0);
+    }
+    if (j % 96 == 48) {
+      ParticlePosition at = (uint32_t)(ParticleRandom() % pixels) << 8;
+      Color color = Wheel(ParticleRandom() % 384);
+      for (byte spark = 0; spark < 12; spark++) {
+        particles.Spawn(at, (int16_t)(ParticleRandom() % 384) - 192,
+                        32 + ParticleRandom() % 32, color.GetRed(),
+                        color.GetGreen(), color.GetBlue());
+      }
+    }
+    mystrip->fadePixels(160);
+    particles.Render(mystrip, pixels);
+    mystrip->show();
+    particles.Update(8, pixels);
+    delay(16);
   }
 }
 
+#ifdef BAKED_ANIMATION
+// Build with -DBAKED_ANIMATION to play the frames in baked_animation.h
+// (written by tools/bake-animation) instead of computing the cycles.
+#  include "baked_animation.h"
 
+ProgmemAnimReader bakedReader(kBakedAnimation);
+AnimPlayer<ProgmemAnimReader> baked(bakedReader);
+#endif
 
 void loop() {
-  switch((iterations / 30) % 3) {
+#ifdef BAKED_ANIMATION
+  baked.NextFrame(mystrip);
+  mystrip->show();
+  delay(baked.frameMillis());
+  return;
+#endif
+
+  switch((iterations / 30) % 6) {
   case 0:
     rainbowCycle();
     break;
@@ -519,37 +1394,224 @@ void loop() {
     blueCycle();
     blueCycle();
     break;
+  case 3:
+    noiseCycle();
+    break;
+  case 4:
+    layeredCycle();
+    break;
+  case 5:
+    particleCycle();
+    break;
   }
 
   iterations++;
 }
 
 #ifndef ARDUINO
-int main(void) {
-  initscr();
-  start_color();
-  if (!can_change_color()) {
-    printw("Can't change colors!\n");
-    puts("Can't change colors!");
-    endwin();
+// "<pixels>x<copies>", as given to -g.
+bool ParseGeometry(const char* arg, StripLayout* layout) {
+  unsigned int pixels, copies;
+  if (sscanf(arg, "%ux%u", &pixels, &copies) != 2 || pixels < 1
+      || pixels > 4096 || copies < 1 || copies > 255) {
+    fprintf(stderr, "bad geometry '%s': want <pixels>x<copies>, at most "
+            "4096x255\n", arg);
+    return false;
+  }
+  layout->pixels = pixels;
+  layout->copies = copies;
+  return true;
+}
+
+// Reads a geometry file for -C: lines of "<key> <value>" with keys
+// pixels, copies, serpentine and mirrored; '#' starts a comment.
+bool LoadGeometry(const char* path, StripLayout* layout) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  int line_number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), in) != NULL) {
+    line_number++;
+    char* comment = strchr(line, '#');
+    if (comment != NULL) {
+      *comment = '\0';
+    }
+    char key[32];
+    unsigned int value;
+    int fields = sscanf(line, "%31s %u", key, &value);
+    if (fields <= 0) {
+      continue;
+    }
+    if (fields != 2) {
+      ok = false;
+    } else if (strcmp(key, "pixels") == 0 && value >= 1 && value <= 4096) {
+      layout->pixels = value;
+    } else if (strcmp(key, "copies") == 0 && value >= 1 && value <= 255) {
+      layout->copies = value;
+    } else if (strcmp(key, "serpentine") == 0) {
+      layout->serpentine = value != 0;
+    } else if (strcmp(key, "mirrored") == 0) {
+      layout->mirrored = value != 0;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "%s:%d: can't use '%s'\n", path, line_number, key);
+    }
+  }
+  fclose(in);
+  return ok;
+}
+
+// Everything any of the strips could need for `layout`, so the arena
+// doesn't depend on which one ends up running.
+size_t ArenaBytes(const StripLayout& layout) {
+  size_t strip = NcursesStrip::AllocBytes(layout);
+  if (AnsiStrip::AllocBytes(layout) > strip) {
+    strip = AnsiStrip::AllocBytes(layout);
+  }
+  if (Strip::AllocBytes(layout.pixels) > strip) {
+    strip = Strip::AllocBytes(layout.pixels);
+  }
+  // Plus the wheel ring, layeredCycle()'s layers and frame, and
+  // alignment for each of the ten buffers.
+  return strip + kPatternMaxPeriod * 3
+      + Compositor::AllocBytes(layout.pixels, kLayerCount + 1)
+      + 10 * Arena::kAlign;
+}
+
+int main(int argc, char** argv) {
+  int max_loops = 10000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:i:P:SMTg:C:A:W:")) != -1) {
+    switch (opt) {
+    case 'r':
+      // Dump raw frames for tools/bake-animation instead of drawing.
+      frameDump = fopen(optarg, "wb");
+      if (frameDump == NULL) {
+        perror(optarg);
+        return 1;
+      }
+      break;
+    case 'i':
+      max_loops = atoi(optarg);
+      break;
+    case 'P':
+      // What to do when a frame runs past its deadline.
+      if (strcmp(optarg, "skip") == 0) {
+        pacer.SetPolicy(kPacerSkip);
+      } else if (strcmp(optarg, "catchup") == 0) {
+        pacer.SetPolicy(kPacerCatchUp);
+      } else {
+        fprintf(stderr, "-P takes catchup or skip\n");
+        return 1;
+      }
+      break;
+    case 'S':
+      layout.serpentine = true;
+      break;
+    case 'M':
+      layout.mirrored = true;
+      break;
+    case 'T':
+      truecolor = true;
+      break;
+    case 'g':
+      if (!ParseGeometry(optarg, &layout)) {
+        return 1;
+      }
+      break;
+    case 'C':
+      if (!LoadGeometry(optarg, &layout)) {
+        return 1;
+      }
+      break;
+    case 'A':
+      // Drive the audio-reactive effects from a WAV file.
+      if (!wav.Load(optarg, kAudioSampleRate)) {
+        return 1;
+      }
+      audioActive = true;
+      break;
+    case 'W':
+      // The supply's limit in mA; 0 only estimates.
+      powerBudgetMa = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-r raw-frame-file] [-i loops] "
+              "[-P catchup|skip] [-S] [-M] [-T] [-g pixelsxcopies] "
+              "[-C geometry-file] [-A wav-file] [-W milliamps]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (!arena.Reserve(ArenaBytes(layout))) {
+    fprintf(stderr, "can't reserve %zu bytes\n", ArenaBytes(layout));
     return 1;
   }
-  use_default_colors();
-  init_pair(128, COLOR_WHITE, COLOR_BLACK);
-  bkgd(COLOR_PAIR(128));
-  printw("max colors: %d\n", COLORS);
-  printw("max pairs: %d\n", COLOR_PAIRS);
-  usleep(1000 * 1000);
+
+  if (frameDump != NULL) {
+    // Simulated time, so the dump doesn't depend on this machine.
+    pacer.SetVirtual(true);
+    pacer.Start();
+    setup();
+    for (int count = 0; count < max_loops; count++) {
+      loop();
+    }
+    fclose(frameDump);
+    pacer.Report(stderr);
+    ReportPower(mystrip->power(), stderr);
+    return 0;
+  }
+
+  if (!truecolor) {
+    initscr();
+    start_color();
+    if (!can_change_color()) {
+      endwin();
+      fprintf(stderr, "Can't change colors; using 24-bit escapes (-T).\n");
+      truecolor = true;
+    } else if (NcursesStrip::kPairBase + layout.pixels > (unsigned)COLORS
+               || NcursesStrip::BackgroundPair(layout)
+                  >= (unsigned)COLOR_PAIRS) {
+      endwin();
+      fprintf(stderr, "Only %d colors and %d pairs for %u pixels; using "
+              "24-bit escapes (-T).\n", COLORS, COLOR_PAIRS, layout.pixels);
+      truecolor = true;
+    } else {
+      use_default_colors();
+      init_pair(NcursesStrip::BackgroundPair(layout), COLOR_WHITE,
+                COLOR_BLACK);
+      bkgd(COLOR_PAIR(NcursesStrip::BackgroundPair(layout)));
+      printw("max colors: %d\n", COLORS);
+      printw("max pairs: %d\n", COLOR_PAIRS);
+      usleep(1000 * 1000);
+    }
+  }
+  pacer.Start();
   setup();
 
+  // Like the board, loop() runs back to back; the effects' delay()s set
+  // the pace.
   int count = 0;
   do {
     loop();
-    usleep(1000);
-  } while (count++ < 10000); //true); // count++ < 1000);
-  endwin();
-  printf("max colors: %d\n", COLORS);
-  printf("max pairs: %d\n", COLOR_PAIRS);
+  } while (count++ < max_loops); //true); // count++ < 1000);
+  PowerBudget power = mystrip->power();
+  // Stops the output thread once the last frame is drawn.
+  delete mystrip;
+  if (!truecolor) {
+    endwin();
+    printf("max colors: %d\n", COLORS);
+    printf("max pairs: %d\n", COLOR_PAIRS);
+  }
+  pacer.Report(stdout);
+  ReportPower(power, stdout);
   return 0;
 }
 #endif
@@ -0,0 +1,114 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+// Host-only clock for the ncurses build, standing in for millis() and
+// delay().
+//
+// Waits are against absolute deadlines (clock_nanosleep with
+// TIMER_ABSTIME), so time spent drawing comes out of the wait instead of
+// adding to it and the simulator keeps the same pace as the board.  When
+// a deadline has already passed the wait is counted as late, and then:
+//   kPacerCatchUp  the deadline stands, so the following waits return
+//                  at once until the schedule is met again
+//   kPacerSkip     the schedule restarts from now and the lost time is
+//                  counted as skipped
+//
+// In virtual mode nothing sleeps and time only moves when waited on, so
+// frame dumps come out the same on any machine.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+enum PacerPolicy {
+  kPacerCatchUp,
+  kPacerSkip,
+};
+
+class FramePacer {
+public:
+  FramePacer():
+    policy_(kPacerCatchUp), virtual_(false), start_(0), deadline_(0),
+    frames_(0), waits_(0), late_(0), worst_us_(0), skipped_us_(0) {};
+
+  void SetPolicy(PacerPolicy policy) {
+    policy_ = policy;
+  };
+
+  void SetVirtual(bool on) {
+    virtual_ = on;
+  };
+
+  void Start() {
+    start_ = virtual_ ? 0 : Now();
+    deadline_ = start_;
+  };
+
+  // Microseconds since Start().
+  int64_t Micros() {
+    return (virtual_ ? deadline_ : Now()) - start_;
+  };
+
+  // Waits until `us` after the previous deadline.
+  void Wait(int64_t us) {
+    deadline_ += us;
+    waits_++;
+    if (virtual_) {
+      return;
+    }
+    int64_t now = Now();
+    if (now > deadline_) {
+      late_++;
+      if (now - deadline_ > worst_us_) {
+        worst_us_ = now - deadline_;
+      }
+      if (policy_ == kPacerSkip) {
+        skipped_us_ += now - deadline_;
+        deadline_ = now;
+      }
+      return;
+    }
+    struct timespec until;
+    until.tv_sec = deadline_ / 1000000;
+    until.tv_nsec = (deadline_ % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)
+           != 0) {
+    }
+  };
+
+  // Called for every frame shown, for the fps figure.
+  void FrameShown() {
+    frames_++;
+  };
+
+  void Report(FILE* out) {
+    double seconds = Micros() / 1e6;
+    fprintf(out, "%lu frames in %.2f s (%.1f fps), %lu of %lu waits late "
+            "(worst %.1f ms)", frames_, seconds,
+            seconds > 0 ? frames_ / seconds : 0.0, late_, waits_,
+            worst_us_ / 1000.0);
+    if (policy_ == kPacerSkip) {
+      fprintf(out, ", %.1f ms skipped", skipped_us_ / 1000.0);
+    }
+    fprintf(out, "\n");
+  };
+
+private:
+  static int64_t Now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  };
+
+  PacerPolicy policy_;
+  bool virtual_;
+  int64_t start_;
+  int64_t deadline_;
+  unsigned long frames_;
+  unsigned long waits_;
+  unsigned long late_;
+  int64_t worst_us_;
+  int64_t skipped_us_;
+};
+
+#endif  // FRAME_PACER_H
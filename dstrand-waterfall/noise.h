@@ -0,0 +1,185 @@
+#ifndef DSTRAND_NOISE_H
+#define DSTRAND_NOISE_H
+
+// 3D value noise in 8-bit fixed point, for effects with organic motion.
+//
+// Coordinates are 8.8 fixed point: the high byte picks the lattice cell
+// and the low byte is the position inside it, so a step of 256 moves one
+// cell.  The lattice values come from Perlin's permutation table (in
+// flash on the board) and are blended with a smoothstep fade, giving
+// 0..255.  Everything is 8x8 and 16-bit math, and one sample ought to be
+// a few hundred cycles on a 16 MHz AVR, which would put a full 176-pixel
+// frame well inside a 30 fps budget.  That is an estimate: avr-bench's
+// Noise3D/call and NoiseRow/frame-176px haven't been run under simavr
+// yet, so the fit on the Uno is unverified.
+//
+// NoiseRow() samples a line of pixels at once.  On hosts with SSE2 it
+// blends eight samples per pass; tools/noise-bench checks it against the
+// scalar code bit for bit.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <avr/pgmspace.h>
+#else
+#  ifndef PROGMEM
+#    define PROGMEM
+#    define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#  endif
+#  ifdef __SSE2__
+#    include <emmintrin.h>
+#  endif
+#endif
+
+const uint8_t kNoisePerm[256] PROGMEM = {
+  151, 160, 137,  91,  90,  15, 131,  13, 201,  95,  96,  53,
+  194, 233,   7, 225, 140,  36, 103,  30,  69, 142,   8,  99,
+   37, 240,  21,  10,  23, 190,   6, 148, 247, 120, 234,  75,
+    0,  26, 197,  62,  94, 252, 219, 203, 117,  35,  11,  32,
+   57, 177,  33,  88, 237, 149,  56,  87, 174,  20, 125, 136,
+  171, 168,  68, 175,  74, 165,  71, 134, 139,  48,  27, 166,
+   77, 146, 158, 231,  83, 111, 229, 122,  60, 211, 133, 230,
+  220, 105,  92,  41,  55,  46, 245,  40, 244, 102, 143,  54,
+   65,  25,  63, 161,   1, 216,  80,  73, 209,  76, 132, 187,
+  208,  89,  18, 169, 200, 196, 135, 130, 116, 188, 159,  86,
+  164, 100, 109, 198, 173, 186,   3,  64,  52, 217, 226, 250,
+  124, 123,   5, 202,  38, 147, 118, 126, 255,  82,  85, 212,
+  207, 206,  59, 227,  47,  16,  58,  17, 182, 189,  28,  42,
+  223, 183, 170, 213, 119, 248, 152,   2,  44, 154, 163,  70,
+  221, 153, 101, 155, 167,  43, 172,   9, 129,  22,  39, 253,
+   19,  98, 108, 110,  79, 113, 224, 232, 178, 185, 112, 104,
+  218, 246,  97, 228, 251,  34, 242, 193, 238, 210, 144,  12,
+  191, 179, 162, 241,  81,  51, 145, 235, 249,  14, 239, 107,
+   49, 192, 214,  31, 181, 199, 106, 157, 184,  84, 204, 176,
+  115, 121,  50,  45, 127,   4, 150, 254, 138, 236, 205,  93,
+  222, 114,  67,  29,  24,  72, 243, 141, 128, 195,  78,  66,
+  215,  61, 156, 180
+};
+
+inline uint8_t NoisePerm(uint8_t i) {
+  return pgm_read_byte(kNoisePerm + i);
+}
+
+// Smoothstep, 3t^2 - 2t^3, with 0..255 standing for 0..1.
+inline uint8_t NoiseFade(uint8_t t) {
+  uint8_t t2 = ((uint16_t)t * t) >> 8;
+  return ((uint32_t)t2 * (768 - 2 * t)) >> 8;
+}
+
+// a + (b - a) * s / 256, rounded down, without going past 16 bits.
+inline uint8_t NoiseLerp(uint8_t a, uint8_t b, uint8_t s) {
+  if (b >= a) {
+    return a + (((uint16_t)(b - a) * s) >> 8);
+  }
+  return a - (((uint16_t)(a - b) * s + 255) >> 8);
+}
+
+// The values at the eight corners of the cell around (x, y, z), ordered
+// by z, then y, then x: c[0] is (0, 0, 0), c[1] is (1, 0, 0), c[2] is
+// (0, 1, 0) and so on.
+inline void NoiseCorners(uint8_t xi, uint8_t yi, uint8_t zi, uint8_t* c) {
+  uint8_t a = NoisePerm(xi) + yi;
+  uint8_t b = NoisePerm(xi + 1) + yi;
+  uint8_t aa = NoisePerm(a) + zi;
+  uint8_t ba = NoisePerm(b) + zi;
+  uint8_t ab = NoisePerm(a + 1) + zi;
+  uint8_t bb = NoisePerm(b + 1) + zi;
+  c[0] = NoisePerm(aa);
+  c[1] = NoisePerm(ba);
+  c[2] = NoisePerm(ab);
+  c[3] = NoisePerm(bb);
+  c[4] = NoisePerm(aa + 1);
+  c[5] = NoisePerm(ba + 1);
+  c[6] = NoisePerm(ab + 1);
+  c[7] = NoisePerm(bb + 1);
+}
+
+inline uint8_t Noise3D(uint16_t x, uint16_t y, uint16_t z) {
+  uint8_t c[8];
+  NoiseCorners(x >> 8, y >> 8, z >> 8, c);
+  uint8_t u = NoiseFade(x);
+  uint8_t v = NoiseFade(y);
+  uint8_t w = NoiseFade(z);
+  uint8_t y0 = NoiseLerp(NoiseLerp(c[0], c[1], u),
+                         NoiseLerp(c[2], c[3], u), v);
+  uint8_t y1 = NoiseLerp(NoiseLerp(c[4], c[5], u),
+                         NoiseLerp(c[6], c[7], u), v);
+  return NoiseLerp(y0, y1, w);
+}
+
+// out[k] = Noise3D(x + k * dx, y, z) for k < count.
+inline void NoiseRowScalar(uint16_t x, uint16_t dx, uint16_t y, uint16_t z,
+                           uint8_t* out, uint16_t count) {
+  for (uint16_t k = 0; k < count; k++, x += dx) {
+    out[k] = Noise3D(x, y, z);
+  }
+}
+
+#if !defined(ARDUINO) && defined(__SSE2__)
+// NoiseLerp() on eight 16-bit lanes.  The signed product (b - a) * s
+// needs 17 bits, so it's put together from its high and low halves
+// before the shift.
+inline __m128i NoiseLerpSse2(__m128i a, __m128i b, __m128i s) {
+  __m128i d = _mm_sub_epi16(b, a);
+  __m128i hi = _mm_mulhi_epi16(d, s);
+  __m128i lo = _mm_mullo_epi16(d, s);
+  __m128i step = _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(lo, 8));
+  return _mm_add_epi16(a, step);
+}
+
+// NoiseFade() on eight 16-bit lanes.
+inline __m128i NoiseFadeSse2(__m128i t) {
+  __m128i t2 = _mm_srli_epi16(_mm_mullo_epi16(t, t), 8);
+  __m128i m = _mm_sub_epi16(_mm_set1_epi16(768), _mm_add_epi16(t, t));
+  __m128i hi = _mm_mulhi_epu16(t2, m);
+  __m128i lo = _mm_mullo_epi16(t2, m);
+  return _mm_or_si128(_mm_slli_epi16(hi, 8), _mm_srli_epi16(lo, 8));
+}
+
+// Same results as NoiseRowScalar().  The table lookups stay scalar (SSE2
+// has no gather); the fades and the seven blends per sample run eight
+// samples at a time.
+inline void NoiseRowSse2(uint16_t x, uint16_t dx, uint16_t y, uint16_t z,
+                         uint8_t* out, uint16_t count) {
+  const __m128i v = _mm_set1_epi16(NoiseFade(y));
+  const __m128i w = _mm_set1_epi16(NoiseFade(z));
+  uint16_t k = 0;
+  for (; k + 8 <= count; k += 8) {
+    // corners[i][lane] is corner i of sample k + lane.
+    uint16_t corners[8][8] __attribute__((aligned(16)));
+    uint16_t fractions[8] __attribute__((aligned(16)));
+    for (int lane = 0; lane < 8; lane++, x += dx) {
+      uint8_t c[8];
+      NoiseCorners(x >> 8, y >> 8, z >> 8, c);
+      for (int i = 0; i < 8; i++) {
+        corners[i][lane] = c[i];
+      }
+      fractions[lane] = x & 0xff;
+    }
+    __m128i c[8];
+    for (int i = 0; i < 8; i++) {
+      c[i] = _mm_load_si128((const __m128i*)corners[i]);
+    }
+    __m128i u = NoiseFadeSse2(_mm_load_si128((const __m128i*)fractions));
+    __m128i y0 = NoiseLerpSse2(NoiseLerpSse2(c[0], c[1], u),
+                               NoiseLerpSse2(c[2], c[3], u), v);
+    __m128i y1 = NoiseLerpSse2(NoiseLerpSse2(c[4], c[5], u),
+                               NoiseLerpSse2(c[6], c[7], u), v);
+    __m128i result = NoiseLerpSse2(y0, y1, w);
+    _mm_storel_epi64((__m128i*)(out + k),
+                     _mm_packus_epi16(result, result));
+  }
+  NoiseRowScalar(x, dx, y, z, out + k, count - k);
+}
+#endif
+
+inline void NoiseRow(uint16_t x, uint16_t dx, uint16_t y, uint16_t z,
+                     uint8_t* out, uint16_t count) {
+#if !defined(ARDUINO) && defined(__SSE2__)
+  NoiseRowSse2(x, dx, y, z, out, count);
+#else
+  NoiseRowScalar(x, dx, y, z, out, count);
+#endif
+}
+
+#endif  // DSTRAND_NOISE_H
@@ -0,0 +1,133 @@
+#ifndef DSTRAND_PARTICLES_H
+#define DSTRAND_PARTICLES_H
+
+// Sparks, comets and fireworks: points of light that move along the
+// strip and fade out, drawn additively over whatever is already there.
+//
+// The pool is sized at compile time, so nothing touches the heap once the
+// sketch is running; on an Uno, with a couple of hundred bytes free,
+// allocating particles one by one would soon fragment it.  Live particles
+// are packed at the front of each array and the free slots are the tail,
+// so Spawn() takes the first free slot and Retire() moves the last live
+// particle into the hole, both O(1), and Update() walks the arrays with
+// no gaps.  Each field is its own array (structure of arrays), so the
+// update loop only touches what it needs.
+//
+// Positions and velocities are fixed point in pixels with 8 fraction
+// bits: the low byte is how far a particle is towards the next pixel.  On
+// the board positions are 16 bits, enough for 255 pixels; the host's
+// longer strips get 32.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+typedef uint16_t ParticlePosition;
+#else
+typedef uint32_t ParticlePosition;
+#endif
+
+// A 16-bit xorshift, so effects don't depend on the platform's random().
+inline uint16_t ParticleRandom() {
+  static uint16_t state = 0xace1;
+  state ^= state << 7;
+  state ^= state >> 9;
+  state ^= state << 8;
+  return state;
+}
+
+template <uint16_t kCapacity>
+class ParticlePool {
+public:
+  ParticlePool():
+    count_(0) {};
+
+  uint16_t count() {
+    return count_;
+  };
+
+  // Adds a particle that lives for `life` frames (at most 255), fading
+  // from the given color to black.  Returns false when the pool is full.
+  bool Spawn(ParticlePosition position, int16_t velocity, uint8_t life,
+             uint8_t red, uint8_t green, uint8_t blue) {
+    if (count_ == kCapacity || life == 0) {
+      return false;
+    }
+    uint16_t i = count_++;
+    position_[i] = position;
+    velocity_[i] = velocity;
+    life_[i] = life;
+    max_life_[i] = life;
+    red_[i] = red;
+    green_[i] = green;
+    blue_[i] = blue;
+    return true;
+  };
+
+  void Retire(uint16_t i) {
+    uint16_t last = --count_;
+    position_[i] = position_[last];
+    velocity_[i] = velocity_[last];
+    life_[i] = life_[last];
+    max_life_[i] = max_life_[last];
+    red_[i] = red_[last];
+    green_[i] = green_[last];
+    blue_[i] = blue_[last];
+  };
+
+  void Clear() {
+    count_ = 0;
+  };
+
+  // Moves every particle one frame, slowing it by `drag` 256ths of its
+  // speed, and retires those that have run out of life or left the first
+  // `pixels` pixels.
+  void Update(uint8_t drag, uint16_t pixels) {
+    uint32_t end = (uint32_t)pixels << 8;
+    for (uint16_t i = 0; i < count_; ) {
+      ParticlePosition position = position_[i] + velocity_[i];
+      // Going off the start wraps round past `end`.
+      if (--life_[i] == 0 || position >= end) {
+        Retire(i);
+        continue;
+      }
+      position_[i] = position;
+      int16_t velocity = velocity_[i];
+      velocity_[i] = velocity - ((int32_t)velocity * drag >> 8);
+      i++;
+    }
+  };
+
+  // Adds every particle to `target`, whose addPixelColor(pixel, r, g, b)
+  // should saturate, at its color times the fraction of life left, and
+  // split between the two pixels it's between.
+  template <class Target>
+  void Render(Target* target, uint16_t pixels) {
+    for (uint16_t i = 0; i < count_; i++) {
+      uint16_t fade = ((uint16_t)life_[i] << 8) / max_life_[i];
+      uint8_t red = (red_[i] * fade) >> 8;
+      uint8_t green = (green_[i] * fade) >> 8;
+      uint8_t blue = (blue_[i] * fade) >> 8;
+      uint16_t pixel = position_[i] >> 8;
+      uint8_t next = position_[i] & 0xff;
+      uint8_t here = 255 - next;
+      target->addPixelColor(pixel, (red * here) >> 8, (green * here) >> 8,
+                            (blue * here) >> 8);
+      if (next != 0 && pixel + 1 < pixels) {
+        target->addPixelColor(pixel + 1, (red * next) >> 8,
+                              (green * next) >> 8, (blue * next) >> 8);
+      }
+    }
+  };
+
+private:
+  uint16_t count_;
+  ParticlePosition position_[kCapacity];
+  int16_t velocity_[kCapacity];
+  uint8_t life_[kCapacity];
+  uint8_t max_life_[kCapacity];
+  uint8_t red_[kCapacity];
+  uint8_t green_[kCapacity];
+  uint8_t blue_[kCapacity];
+};
+
+#endif  // DSTRAND_PARTICLES_H
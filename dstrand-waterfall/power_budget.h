@@ -0,0 +1,98 @@
+#ifndef DSTRAND_POWER_BUDGET_H
+#define DSTRAND_POWER_BUDGET_H
+
+// Keeps a frame's estimated current draw inside what the supply can give,
+// so a bright frame dims a little instead of browning the board out.
+//
+// The strip keeps the sum of every pixel's channels up to date as pixels
+// are set, one add and one subtract each, so at show() the estimate is a
+// couple of multiplies however long the strip is.  The draw is modeled
+// as linear in channel value, plus a fixed draw per LED for the driver
+// chips; PowerModel has rough figures per chipset (measure yours for
+// anything tighter).  When a frame would go over budget, Frame() returns
+// the one scale for the whole frame that brings it back under, so hues
+// stay as they were and only the brightness drops.
+
+#include <stdint.h>
+
+struct PowerModel {
+  uint16_t ua_per_unit;  // Microamps per step of one channel.
+  uint16_t idle_ua;      // Microamps per LED when dark.
+};
+
+// About 20 mA per channel at 127, all the LPD8806 takes.
+const PowerModel kPowerLpd8806 = {157, 500};
+// About 20 mA per channel at 255.
+const PowerModel kPowerWs2811 = {78, 1000};
+
+class PowerBudget {
+public:
+  PowerBudget(const PowerModel& model):
+    model_(model), leds_(0), copies_(1), budget_ma_(0), peak_ma_(0),
+    total_ma_(0), frames_(0), limited_(0) {};
+
+  // `leds` pixels, each sent to `copies` strands, from a supply that
+  // gives `milliamps`; 0 turns the limit off but still keeps count.
+  void SetLimit(uint16_t leds, uint8_t copies, uint16_t milliamps) {
+    leds_ = leds;
+    copies_ = copies;
+    budget_ma_ = milliamps;
+  };
+
+  // Called once per frame, before it's sent, with the sum of every
+  // pixel's channels and the strip's brightness (255 is as set).
+  // Returns the scale to apply on top of the brightness, 255 for none.
+  uint8_t Frame(uint32_t units, uint8_t brightness) {
+    uint32_t lit = (units * copies_ * (brightness + 1)) >> 8;
+    uint32_t idle_ua = (uint32_t)leds_ * copies_ * model_.idle_ua;
+    uint32_t ua = idle_ua + lit * model_.ua_per_unit;
+    uint8_t scale = 255;
+    if (budget_ma_ > 0 && ua > (uint32_t)budget_ma_ * 1000) {
+      uint32_t room_ua = (uint32_t)budget_ma_ * 1000 > idle_ua
+          ? (uint32_t)budget_ma_ * 1000 - idle_ua : 0;
+      // In channel steps, to stay within 32 bits.  It's under lit here,
+      // so the scale is under 255.
+      uint32_t room = room_ua / model_.ua_per_unit;
+      scale = room * 255 / lit;
+      ua = idle_ua + lit * scale / 255 * model_.ua_per_unit;
+      limited_++;
+    }
+    uint16_t ma = ua / 1000;
+    if (ma > peak_ma_) {
+      peak_ma_ = ma;
+    }
+    total_ma_ += ma;
+    frames_++;
+    return scale;
+  };
+
+  // Estimated draw as sent, after any limiting.
+  uint16_t peakMilliamps() {
+    return peak_ma_;
+  };
+
+  uint16_t averageMilliamps() {
+    return frames_ > 0 ? total_ma_ / frames_ : 0;
+  };
+
+  // Frames that had to be dimmed.
+  uint32_t limited() {
+    return limited_;
+  };
+
+  uint32_t frames() {
+    return frames_;
+  };
+
+private:
+  PowerModel model_;
+  uint16_t leds_;
+  uint8_t copies_;
+  uint16_t budget_ma_;
+  uint16_t peak_ma_;
+  uint64_t total_ma_;
+  uint32_t frames_;
+  uint32_t limited_;
+};
+
+#endif  // DSTRAND_POWER_BUDGET_H
@@ -0,0 +1,132 @@
+// Checks the audio analysis on test tones and times it.
+//
+// Usage: audio-bench [-f frames] [wav-file]
+//
+//   -f N  frames to time (default 200000)
+//
+// Each test tone has to come out loudest in the band it falls in.  The
+// timing runs the analysis over the WAV file, or over the test tones
+// without one, and prints analyzed frames per second against the 30 a
+// second the effects need.  With a file it also prints the mean level
+// of each band.
+//
+// The timing is the host's, not the Uno's; avr-bench times the board.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../audio.h"
+#include "../wav.h"
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// A tone at the middle of each band, at 3/4 of full scale.
+std::vector<int16_t> Tone(uint8_t band, int frames) {
+  uint8_t bin = (kAudioBandStart[band] + kAudioBandStart[band + 1]) / 2;
+  double hz = (double)bin * kAudioSampleRate / kAudioFftSize;
+  std::vector<int16_t> samples(frames * kAudioFftSize);
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = 12288 * sin(2 * M_PI * hz * i / kAudioSampleRate);
+  }
+  return samples;
+}
+
+int CheckTones() {
+  int failures = 0;
+  for (uint8_t band = 0; band < kAudioBands; band++) {
+    std::vector<int16_t> samples = Tone(band, 4);
+    AudioAnalyzer analyzer;
+    for (int frame = 0; frame < 4; frame++) {
+      analyzer.Analyze(&samples[frame * kAudioFftSize]);
+    }
+    for (uint8_t other = 0; other < kAudioBands; other++) {
+      if (other != band && analyzer.level(other) >= analyzer.level(band)) {
+        fprintf(stderr, "tone for band %d: band %d is at %d, it's at %d\n",
+                band, other, analyzer.level(other), analyzer.level(band));
+        failures++;
+      }
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  int frames = 200000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:")) != -1) {
+    switch (opt) {
+    case 'f': frames = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: audio-bench [-f frames] [wav-file]\n");
+      return 1;
+    }
+  }
+  if (frames < 1 || optind < argc - 1) {
+    fprintf(stderr, "usage: audio-bench [-f frames] [wav-file]\n");
+    return 1;
+  }
+
+  if (CheckTones() > 0) {
+    return 1;
+  }
+
+  std::vector<int16_t> sound;
+  if (optind < argc) {
+    WavSource wav;
+    if (!wav.Load(argv[optind], kAudioSampleRate)) {
+      return 1;
+    }
+    for (uint32_t i = 0; i < wav.size(); i++) {
+      sound.push_back(wav.At(i));
+    }
+  } else {
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      std::vector<int16_t> tone = Tone(band, 16);
+      sound.insert(sound.end(), tone.begin(), tone.end());
+    }
+  }
+  size_t available = sound.size() / kAudioFftSize;
+  if (available == 0) {
+    fprintf(stderr, "less than one frame of sound\n");
+    return 1;
+  }
+
+  AudioAnalyzer analyzer;
+  std::vector<uint64_t> sums(kAudioBands);
+  int16_t samples[kAudioFftSize];
+  double start = Now();
+  for (int frame = 0; frame < frames; frame++) {
+    const int16_t* from = &sound[(frame % available) * kAudioFftSize];
+    for (int i = 0; i < kAudioFftSize; i++) {
+      samples[i] = from[i];
+    }
+    analyzer.Analyze(samples);
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      sums[band] += analyzer.level(band);
+    }
+  }
+  double seconds = Now() - start;
+
+  printf("%d-point FFT and %d bands: %.0f frames/s (%.0fx 30 fps), "
+         "%.2f us/frame\n", kAudioFftSize, kAudioBands, frames / seconds,
+         frames / seconds / 30, seconds / frames * 1e6);
+  if (optind < argc) {
+    printf("mean levels:");
+    for (uint8_t band = 0; band < kAudioBands; band++) {
+      printf(" %3d", (int)(sums[band] / frames));
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,180 @@
+// Bakes raw frames into the compressed animation format in anim_codec.h.
+//
+// Usage: bake-animation -n pixels [options] raw-frames
+//
+//   -n N    pixels per frame in the raw file (required)
+//   -k N    emit a key frame every N frames (default 0: only the first)
+//   -d MS   milliseconds per frame stored for playback (default 4)
+//   -s N    first frame to take (default 0)
+//   -c N    number of frames to take (default: the rest of the file)
+//   -o F    output file (default stdout)
+//   -b      write the binary stream (e.g. for an SD card) instead of a
+//           C header with a PROGMEM array
+//
+// Raw frames come from the ncurses build's -r option: r, g, b bytes per
+// pixel, frames back to back.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../anim_codec.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+bool SamePixel(const uint8_t* a, const uint8_t* b) {
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Appends one frame's ops.  prev is NULL for key frames.
+void EncodeFrame(const uint8_t* frame, const uint8_t* prev, int pixels,
+                 Bytes* out) {
+  out->push_back(prev == NULL ? kAnimKeyFrame : kAnimDeltaFrame);
+
+  int i = 0;
+  while (i < pixels) {
+    // Unchanged pixels cost one byte per 64.
+    if (prev != NULL && SamePixel(frame + 3 * i, prev + 3 * i)) {
+      int n = 1;
+      while (i + n < pixels && n < kAnimMaxSkip
+             && SamePixel(frame + 3 * (i + n), prev + 3 * (i + n))) {
+        n++;
+      }
+      out->push_back(0xc0 | (n - 1));
+      i += n;
+      continue;
+    }
+
+    int run = 1;
+    while (i + run < pixels && run < kAnimMaxRun
+           && SamePixel(frame + 3 * (i + run), frame + 3 * i)) {
+      run++;
+    }
+    if (run >= 2) {
+      out->push_back(0x80 | (run - 1));
+      out->insert(out->end(), frame + 3 * i, frame + 3 * i + 3);
+      i += run;
+      continue;
+    }
+
+    // Literal, up to the next unchanged pixel or run of two.
+    int n = 1;
+    while (i + n < pixels && n < kAnimMaxLiteral) {
+      const uint8_t* p = frame + 3 * (i + n);
+      if (prev != NULL && SamePixel(p, prev + 3 * (i + n))) {
+        break;
+      }
+      if (i + n + 1 < pixels && SamePixel(p, p + 3)) {
+        break;
+      }
+      n++;
+    }
+    out->push_back(n - 1);
+    out->insert(out->end(), frame + 3 * i, frame + 3 * (i + n));
+    i += n;
+  }
+}
+
+void Usage() {
+  fprintf(stderr, "usage: bake-animation -n pixels [-k keyframe_interval] "
+          "[-d frame_ms] [-s first] [-c count] [-o out] [-b] raw-frames\n");
+}
+
+int main(int argc, char** argv) {
+  int pixels = 0;
+  int key_interval = 0;
+  int frame_ms = 4;
+  long first = 0;
+  long count = -1;
+  const char* out_path = NULL;
+  bool binary = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:k:d:s:c:o:b")) != -1) {
+    switch (opt) {
+    case 'n': pixels = atoi(optarg); break;
+    case 'k': key_interval = atoi(optarg); break;
+    case 'd': frame_ms = atoi(optarg); break;
+    case 's': first = atol(optarg); break;
+    case 'c': count = atol(optarg); break;
+    case 'o': out_path = optarg; break;
+    case 'b': binary = true; break;
+    default: Usage(); return 1;
+    }
+  }
+  if (pixels <= 0 || pixels > 0xffff || optind >= argc
+      || frame_ms < 0 || frame_ms > 255) {
+    Usage();
+    return 1;
+  }
+
+  FILE* in = fopen(argv[optind], "rb");
+  if (in == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+  size_t frame_size = 3 * pixels;
+  Bytes frame(frame_size);
+  Bytes prev(frame_size);
+  Bytes stream(kAnimHeaderSize);
+
+  if (fseek(in, first * frame_size, SEEK_SET) != 0) {
+    perror("seek");
+    return 1;
+  }
+  long frames = 0;
+  while ((count < 0 || frames < count) && frames < 0xffff
+         && fread(frame.data(), 1, frame_size, in) == frame_size) {
+    bool key = frames == 0 || (key_interval > 0 && frames % key_interval == 0);
+    EncodeFrame(frame.data(), key ? NULL : prev.data(), pixels, &stream);
+    prev.swap(frame);
+    frames++;
+  }
+  fclose(in);
+  if (frames == 0) {
+    fprintf(stderr, "no frames read\n");
+    return 1;
+  }
+
+  stream[0] = 'A';
+  stream[1] = 'N';
+  stream[2] = kAnimVersion;
+  stream[3] = pixels & 0xff;
+  stream[4] = pixels >> 8;
+  stream[5] = frames & 0xff;
+  stream[6] = frames >> 8;
+  stream[7] = frame_ms;
+
+  FILE* out = stdout;
+  if (out_path != NULL) {
+    out = fopen(out_path, binary ? "wb" : "w");
+    if (out == NULL) {
+      perror(out_path);
+      return 1;
+    }
+  }
+  if (binary) {
+    fwrite(stream.data(), 1, stream.size(), out);
+  } else {
+    fprintf(out, "// Generated by tools/bake-animation: %ld frames of %d "
+            "pixels.\n", frames, pixels);
+    fprintf(out, "const uint8_t kBakedAnimation[%zu] PROGMEM = {",
+            stream.size());
+    for (size_t i = 0; i < stream.size(); i++) {
+      fprintf(out, "%s0x%02x,", i % 12 == 0 ? "\n  " : " ", stream[i]);
+    }
+    fprintf(out, "\n};\n");
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  fprintf(stderr, "%ld frames, %zu bytes raw, %zu bytes baked (%.1f%%)\n",
+          frames, frames * frame_size, stream.size(),
+          100.0 * stream.size() / (frames * frame_size));
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Checks the SSE2 blends against the scalar ones and times compositing.
+//
+// Usage: compositor-bench [-p pixels] [-l layers] [-f frames]
+//
+//   -p N  pixels per layer (default 176, the 8 x 22 installation)
+//   -l N  layers composited per frame (default 3, up to 4)
+//   -f N  frames to time (default 100000)
+//
+// Prints composited frames per second and the time per frame.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../compositor.h"
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+const char* kModeNames[] = {"alpha", "add", "multiply", "max"};
+
+// Every mode and opacity over spans with every pair of byte values.
+int CheckBlends() {
+  const uint16_t kBytes = 65535;
+  std::vector<uint8_t> src(kBytes), base(kBytes), scalar(kBytes),
+      fast(kBytes);
+  for (uint32_t i = 0; i < kBytes; i++) {
+    base[i] = i & 0xff;
+    src[i] = i >> 8;
+  }
+  int mismatches = 0;
+  for (int mode = kBlendAlpha; mode <= kBlendMax; mode++) {
+    for (int opacity = 0; opacity < 256; opacity++) {
+      scalar = base;
+      fast = base;
+      BlendSpanScalar((BlendMode)mode, opacity, scalar.data(), src.data(),
+                      kBytes);
+      BlendSpan((BlendMode)mode, opacity, fast.data(), src.data(), kBytes);
+      if (scalar != fast) {
+        fprintf(stderr, "%s at opacity %d differs\n", kModeNames[mode],
+                opacity);
+        mismatches++;
+      }
+    }
+  }
+  return mismatches;
+}
+
+int main(int argc, char** argv) {
+  int pixels = 176;
+  int layers = 3;
+  int frames = 100000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:l:f:")) != -1) {
+    switch (opt) {
+    case 'p': pixels = atoi(optarg); break;
+    case 'l': layers = atoi(optarg); break;
+    case 'f': frames = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: compositor-bench [-p pixels] [-l layers] "
+              "[-f frames]\n");
+      return 1;
+    }
+  }
+  if (pixels < 1 || pixels > 21845 || layers < 1
+      || layers > kCompositorMaxLayers || frames < 1) {
+    fprintf(stderr, "usage: compositor-bench [-p pixels] [-l layers] "
+            "[-f frames]\n");
+    return 1;
+  }
+
+  if (CheckBlends() > 0) {
+    return 1;
+  }
+
+  std::vector<uint8_t> buffer(Compositor::AllocBytes(pixels, layers));
+  std::vector<uint8_t> out(pixels * 3);
+  Compositor compositor(pixels, layers, buffer.data());
+  for (size_t i = 0; i < buffer.size(); i++) {
+    buffer[i] = rand();
+  }
+  // The bottom layer is copied; the rest cycle through the blend modes.
+  for (int layer = 1; layer < layers; layer++) {
+    compositor.SetBlend(layer, (BlendMode)(layer % 4), 200);
+  }
+
+  double start = Now();
+  for (int f = 0; f < frames; f++) {
+    compositor.SetOpacity(layers - 1, f);
+    compositor.Composite(out.data());
+  }
+  double seconds = Now() - start;
+  printf("%d layers of %d pixels: %.0f frames/s, %.2f us/frame\n", layers,
+         pixels, frames / seconds, seconds / frames * 1e6);
+  return 0;
+}
@@ -0,0 +1,94 @@
+// Checks the SSE2 noise row against the scalar one and times both.
+//
+// Usage: noise-bench [-p pixels] [-f frames]
+//
+//   -p N  samples per frame (default 176, the 8 x 22 installation)
+//   -f N  frames to time (default 100000)
+//
+// Prints samples per second for each path and how many such frames fit
+// in one 30 fps frame time, on the host; avr-bench times the board.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../noise.h"
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+typedef void (*RowFunction)(uint16_t, uint16_t, uint16_t, uint16_t,
+                            uint8_t*, uint16_t);
+
+// Returns seconds for `frames` rows of `pixels`, moving through z.
+double Time(RowFunction row, int pixels, int frames, uint8_t* out) {
+  double start = Now();
+  for (int f = 0; f < frames; f++) {
+    row(f * 7, 40, f * 3, f * 5, out, pixels);
+  }
+  return Now() - start;
+}
+
+void Report(const char* name, double seconds, int pixels, int frames) {
+  double rate = (double)pixels * frames / seconds;
+  printf("%-7s %8.1f Msamples/s  %8.0f frames of %d per 33 ms\n", name,
+         rate / 1e6, rate / 30 / pixels, pixels);
+}
+
+int main(int argc, char** argv) {
+  int pixels = 176;
+  int frames = 100000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:f:")) != -1) {
+    switch (opt) {
+    case 'p': pixels = atoi(optarg); break;
+    case 'f': frames = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: noise-bench [-p pixels] [-f frames]\n");
+      return 1;
+    }
+  }
+  if (pixels < 1 || pixels > 65535 || frames < 1) {
+    fprintf(stderr, "usage: noise-bench [-p pixels] [-f frames]\n");
+    return 1;
+  }
+
+  std::vector<uint8_t> scalar(pixels);
+  std::vector<uint8_t> fast(pixels);
+
+  // Every fraction and lattice cell, at a few step sizes.
+  int mismatches = 0;
+  for (int step = 1; step < 1024; step += 97) {
+    for (int z = 0; z < 65536; z += 4099) {
+      NoiseRowScalar(0, step, z * 3, z, scalar.data(), pixels);
+      NoiseRow(0, step, z * 3, z, fast.data(), pixels);
+      if (memcmp(scalar.data(), fast.data(), pixels) != 0) {
+        mismatches++;
+      }
+    }
+  }
+  if (mismatches > 0) {
+    fprintf(stderr, "%d rows differ between the scalar and fast paths\n",
+            mismatches);
+    return 1;
+  }
+
+  Report("scalar", Time(NoiseRowScalar, pixels, frames, scalar.data()),
+         pixels, frames);
+#ifdef __SSE2__
+  Report("sse2", Time(NoiseRowSse2, pixels, frames, fast.data()), pixels,
+         frames);
+#else
+  printf("sse2    not available on this host\n");
+#endif
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Times the particle pool: spawn, update and additive render.
+//
+// Usage: particle-bench [-p pixels] [-n particles] [-f frames]
+//
+//   -p N  pixels in the strip (default 176, the 8 x 22 installation)
+//   -n N  particles kept alive (default 4096, the most the pool holds)
+//   -f N  frames to time (default 20000)
+//
+// Particles that retire are respawned each frame, so the pool stays full
+// and every frame pays for some spawns as well as the update and render.
+// Prints the time per particle and how many particles a frame could
+// carry at 30 fps.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "../particles.h"
+
+#define kBenchCapacity 4096
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Stands in for the sketch's Strip.
+class Frame {
+public:
+  Frame(int pixels):
+    rgb_(pixels * 3) {};
+
+  void addPixelColor(uint16_t pixel, uint8_t red, uint8_t green,
+                     uint8_t blue) {
+    uint8_t* p = &rgb_[pixel * 3];
+    p[0] = p[0] + red < 127 ? p[0] + red : 127;
+    p[1] = p[1] + green < 127 ? p[1] + green : 127;
+    p[2] = p[2] + blue < 127 ? p[2] + blue : 127;
+  };
+
+  void Fade() {
+    for (size_t i = 0; i < rgb_.size(); i++) {
+      rgb_[i] = rgb_[i] * 5 / 8;
+    }
+  };
+
+  uint8_t first() {
+    return rgb_[0];
+  };
+
+private:
+  std::vector<uint8_t> rgb_;
+};
+
+ParticlePool<kBenchCapacity> pool;
+
+void Fill(int particles, int pixels) {
+  while (pool.count() < particles) {
+    pool.Spawn((uint32_t)(ParticleRandom() % pixels) << 8,
+               (int16_t)(ParticleRandom() % 384) - 192,
+               16 + ParticleRandom() % 64, 96, 48, 127);
+  }
+}
+
+int main(int argc, char** argv) {
+  int pixels = 176;
+  int particles = kBenchCapacity;
+  int frames = 20000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:f:")) != -1) {
+    switch (opt) {
+    case 'p': pixels = atoi(optarg); break;
+    case 'n': particles = atoi(optarg); break;
+    case 'f': frames = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: particle-bench [-p pixels] [-n particles] "
+              "[-f frames]\n");
+      return 1;
+    }
+  }
+  if (pixels < 1 || pixels > 65535 || particles < 1
+      || particles > kBenchCapacity || frames < 1) {
+    fprintf(stderr, "usage: particle-bench [-p pixels] [-n particles] "
+            "[-f frames]\n");
+    return 1;
+  }
+
+  Frame frame(pixels);
+  unsigned long spawned = 0;
+  double start = Now();
+  for (int f = 0; f < frames; f++) {
+    int before = pool.count();
+    Fill(particles, pixels);
+    spawned += pool.count() - before;
+    frame.Fade();
+    pool.Render(&frame, pixels);
+    pool.Update(8, pixels);
+  }
+  double seconds = Now() - start;
+  double per_particle = seconds / frames / particles;
+
+  printf("%d particles on %d pixels: %.2f us/frame, %.1f ns/particle, "
+         "%.1f%% respawned per frame\n", particles, pixels,
+         seconds / frames * 1e6, per_particle * 1e9,
+         100.0 * spawned / frames / particles);
+  printf("about %.0f particles/frame at 30 fps (ignoring the fade)\n",
+         1.0 / 30 / per_particle);
+  // Uses the frame so the rendering can't be optimized away.
+  return frame.first() == 255;
+}
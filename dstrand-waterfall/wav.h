@@ -0,0 +1,128 @@
+#ifndef WAV_H
+#define WAV_H
+
+// Host-only sound source for the audio-reactive effects (-A), so they can
+// be run and dumped offline.
+//
+// Reads a 16-bit PCM WAV file of any rate and channel count, mixes it
+// down to mono and resamples it to `rate` by averaging each output
+// sample's span of input, which also keeps the top octave from folding
+// back.  Samples come out halved, within the +-16384 audio.h wants, the
+// same as the board's ADC readings are scaled.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+class WavSource {
+public:
+  // Prints what's wrong and returns false on anything but 16-bit PCM.
+  bool Load(const char* path, uint32_t rate) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL) {
+      perror(path);
+      return false;
+    }
+    bool ok = Read(in, path, rate);
+    fclose(in);
+    return ok;
+  };
+
+  uint32_t size() {
+    return samples_.size();
+  };
+
+  // Sample `index`, wrapping around so the sound loops.
+  int16_t At(int64_t index) {
+    int64_t n = samples_.size();
+    return samples_[((index % n) + n) % n];
+  };
+
+private:
+  static uint32_t Le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+  };
+
+  static uint16_t Le16(const uint8_t* p) {
+    return p[0] | p[1] << 8;
+  };
+
+  bool Read(FILE* in, const char* path, uint32_t rate) {
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), in) != sizeof(riff)
+        || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+      fprintf(stderr, "%s: not a WAV file\n", path);
+      return false;
+    }
+
+    uint16_t channels = 0;
+    uint32_t in_rate = 0;
+    uint8_t header[8];
+    while (fread(header, 1, sizeof(header), in) == sizeof(header)) {
+      uint32_t length = Le32(header + 4);
+      if (memcmp(header, "fmt ", 4) == 0) {
+        uint8_t format[16];
+        if (length < sizeof(format)
+            || fread(format, 1, sizeof(format), in) != sizeof(format)) {
+          break;
+        }
+        if (Le16(format) != 1 || Le16(format + 14) != 16) {
+          fprintf(stderr, "%s: only 16-bit PCM is supported\n", path);
+          return false;
+        }
+        channels = Le16(format + 2);
+        in_rate = Le32(format + 4);
+        fseek(in, length - sizeof(format) + (length & 1), SEEK_CUR);
+      } else if (memcmp(header, "data", 4) == 0) {
+        if (channels == 0 || in_rate == 0) {
+          break;
+        }
+        std::vector<uint8_t> data(length);
+        length = fread(data.data(), 1, length, in);
+        Resample(data.data(), length / (2 * channels), channels, in_rate,
+                 rate);
+        if (samples_.empty()) {
+          fprintf(stderr, "%s: no samples\n", path);
+          return false;
+        }
+        return true;
+      } else {
+        fseek(in, length + (length & 1), SEEK_CUR);
+      }
+    }
+    fprintf(stderr, "%s: no format or data chunk\n", path);
+    return false;
+  };
+
+  void Resample(const uint8_t* data, uint32_t frames, uint16_t channels,
+                uint32_t in_rate, uint32_t rate) {
+    samples_.clear();
+    uint32_t from = 0;
+    for (uint64_t out = 1; ; out++) {
+      uint32_t to = out * in_rate / rate;
+      if (to > frames) {
+        break;
+      }
+      int64_t sum = 0;
+      uint32_t count = 0;
+      for (uint32_t frame = from; frame < to; frame++, count += channels) {
+        for (uint16_t channel = 0; channel < channels; channel++) {
+          sum += (int16_t)Le16(data + (frame * channels + channel) * 2);
+        }
+      }
+      // Upsampling repeats the last input sample.
+      if (count == 0) {
+        samples_.push_back(samples_.empty() ? 0 : samples_.back());
+      } else {
+        samples_.push_back(sum / count / 2);
+      }
+      from = to;
+    }
+  };
+
+  std::vector<int16_t> samples_;
+};
+
+#endif  // WAV_H
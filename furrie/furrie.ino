@@ -14,6 +14,8 @@
  *  This example code released under the Apache License
  */
 #include <whoasense.h>
+#include "telemetry.h"
+#include "touch_detector.h"
 
 ////////////////////////////////////////////////////////////////////////
 // Here are the main levers which control the operation of this program
@@ -49,7 +51,8 @@ void doSomeOtherNonsense() {
 
 bool ENABLE_logOnTransition;
 void setup() {
-  Serial.begin(9600); 
+  // Fast enough for the telemetry: see telemetry.h.
+  Serial.begin(kTelemetryBaud);
   initWhoaBoard();
 
 //////////////////////////////////////////////////////////////////
@@ -82,12 +85,6 @@ void setup() {
 //////////////////////////////////////////////////////////////////
 
 
-char impulseBuffer[50];
-char derivativeBuffer[50];
-
-#define PrintLineSize 200
-char logBuffer[PrintLineSize];
-
 bool isTouched = false;
 bool whereTouched[] = {false, false, false, false};
 
@@ -101,45 +98,61 @@ int chanChangeCount;
 int* rawSenseResults;
 bool isPastThreshold;
 
+#if increaseWindow > kTouchMaxWindow
+#  error "increaseWindow is larger than TouchDetector supports"
+#endif
+
+TouchDetector detectors[sizeof(whereTouched)];
+int detectorHistoryIter = -1;
+
+// Feeds each new history sample to the per-channel detectors.  Normally
+// that's one sample per loop; the full rescan is only needed the first
+// time round, or if the window doesn't fit inside the history ring.
+// Returns how many samples came in, which the sense records carry so a
+// replay can tell when it hasn't seen them all.
+int updateDetectors() {
+  int historySize = whoaConfig.senseHistorySize;
+  if (detectorHistoryIter < 0 || increaseWindow >= historySize) {
+    for (int channel = 0; channel < channelCount; channel++) {
+      detectors[channel].SetWindow(increaseWindow);
+      detectors[channel].Prime(senseHistory[channel], historySize,
+                               senseHistoryIter);
+    }
+    int samples = detectorHistoryIter < 0 ? historySize
+        : (senseHistoryIter - detectorHistoryIter + historySize) % historySize;
+    detectorHistoryIter = senseHistoryIter;
+    return samples;
+  }
+
+  int samples = 0;
+  while (detectorHistoryIter != senseHistoryIter) {
+    samples++;
+    detectorHistoryIter++;
+    if (detectorHistoryIter == historySize) {
+      detectorHistoryIter = 0;
+    }
+    for (int channel = 0; channel < channelCount; channel++) {
+      detectors[channel].Push(senseHistory[channel][detectorHistoryIter]);
+    }
+  }
+  return samples;
+}
+
 void loop() {
     rawSenseResults = senseAll(1700, true);
     
     doSomeOtherNonsense();
+
+    int newSamples = updateDetectors();
     
     for (int channel = 0; channel < channelCount; channel++) { 
       chanImpulse =  senseHistory[channel][(senseHistoryIter + 1 + whoaConfig.senseHistorySize) % whoaConfig.senseHistorySize] 
                      - senseHistory[channel][senseHistoryIter];
-      chanChangeCount = 0;
+      chanChangeCount = detectors[channel].ChangeCount();
 
-      int senseDiff;
-      for (int steps = 0; steps < increaseWindow; steps++) {
-        senseDiff = senseHistory[channel][(senseHistoryIter - (steps + 1) + whoaConfig.senseHistorySize) % whoaConfig.senseHistorySize]
-            - senseHistory[channel][(senseHistoryIter - (steps) + whoaConfig.senseHistorySize) % whoaConfig.senseHistorySize];
-        
-        if (senseDiff > 0) {
-          chanChangeCount += 1; 
-        }
-        if (senseDiff < -2) {
-          chanChangeCount = -1; 
-          break;
-        }
-      }
-      
-
-      if (chanChangeCount >= pureIncreaseThreshold) { 
-        isPastThreshold = true;
-      }
-      else if (chanChangeCount > pureIncreaseThreshold - 3) { 
-        if (impulseThresholdBars[pureIncreaseThreshold - chanChangeCount] < chanImpulse) { 
-          isPastThreshold = true;
-        }
-        else { 
-          isPastThreshold = false;
-        }
-      }
-      else { 
-        isPastThreshold = false;
-      }
+      isPastThreshold = TouchPastThreshold(chanChangeCount, chanImpulse,
+                                           pureIncreaseThreshold,
+                                           impulseThresholdBars);
 
       
       if (switchedCount == 0 && isPastThreshold){
@@ -147,50 +160,19 @@ void loop() {
         whereTouched[channel] = true;
         
         if (ENABLE_logOnTransition == true) { 
-          snprintf(logBuffer, PrintLineSize, "Switched channel: %d Measurement: %d Impulse: %d Adj transition count: %d",
-            channel, senseHistory[channel][senseHistoryIter], chanImpulse, chanChangeCount);
-          Serial.println(logBuffer);
+          TelemetryLog(kTelemetrySwitch, channel,
+                       senseHistory[channel][senseHistoryIter],
+                       chanImpulse, chanChangeCount);
         }
       }
 
       if (whoaConfig.ENABLE_logging) { 
-        // EXEX - Logging inline - pull into a function!
-        int derivativelen;
-        int impulselen;
-    
-        switch (channel) {
-          case 0:
-            impulselen = sprintf(impulseBuffer, "Imp: %d, ",
-                                 chanImpulse);
-            derivativelen = sprintf(derivativeBuffer, "Change: %d, ",
-                                    chanChangeCount);
-    
-            break;
-    
-          case 1:
-          case 2:
-          case 3:
-            impulselen += sprintf(impulseBuffer + impulselen, "%d, ",
-                                  chanImpulse);
-            derivativelen += sprintf(derivativeBuffer + derivativelen, "%d, ",
-                                     chanChangeCount);
-            break;
-    
-          default:
-            break;
-        }
+        TelemetryLog(kTelemetrySense, channel,
+                     senseHistory[channel][senseHistoryIter],
+                     chanImpulse, chanChangeCount, newSamples);
       }
    
     }
-    if (whoaConfig.ENABLE_logging) {
-      snprintf(logBuffer, PrintLineSize, "%20s %23s %20s %20s %s",
-               signalBuffer,
-               impulseBuffer, 
-               derivativeBuffer,
-               processSenseBuffer, "");
-    
-      Serial.println(logBuffer);
-    }
 
     if (whoaConfig.ENABLE_rawLogging) {
       if (rawSenseHistoryIter == 0) { 
@@ -203,8 +185,7 @@ void loop() {
       for (int chan = 0; chan < channelCount; chan++) {
         if (whereTouched[chan]) { 
           if (whoaConfig.ENABLE_logging) { 
-            Serial.println("SWITCHED CHANNEL!");
-            Serial.println(chan);
+            TelemetryLog(kTelemetryToggle, chan, 0, 0, 0);
           }
           whereTouched[chan] = false;
           int chan_to_adjust = (chan + 1) % sizeof(whereTouched);
@@ -229,4 +210,5 @@ void loop() {
       switchedCount--;
     }
 
+    TelemetryDrain();
 }
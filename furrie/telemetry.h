@@ -0,0 +1,145 @@
+#ifndef FURRIE_TELEMETRY_H
+#define FURRIE_TELEMETRY_H
+
+// Compact binary telemetry for the touch-sensing loop.
+//
+// Formatting log lines with sprintf and pushing them out at 9600 baud
+// used to eat most of each loop.  Instead, loop() appends fixed-size
+// records to a small RAM ring, and TelemetryDrain() hands whole records
+// to Serial only when its TX buffer can take them without blocking.  If
+// the ring is full the newest record is dropped; the sequence number lets
+// the decoder (tools/decode-telemetry) report the gap.
+//
+// The line has to keep up, or most records are dropped: with logging on,
+// each loop queues a record per channel, 40 bytes.  9600 baud moves about
+// 960 bytes a second, 24 loops' worth; kTelemetryBaud moves 11520,
+// enough for a loop every 3.5 ms.  A loop() any faster than that still
+// drops records, and the decoder says how many.
+//
+// Wire format, one record:
+//   [0]    kTelemetrySync
+//   [1]    type (TelemetryType)
+//   [2]    sequence number, wraps at 256
+//   [3]    channel (low nibble); history samples the loop took in, capped
+//          at 15 (high nibble, 0 in captures from before it was sent)
+//   [4]    change count (int8_t)
+//   [5..6] measurement (int16_t, little endian)
+//   [7..8] impulse (int16_t, little endian)
+//   [9]    checksum: xor of bytes 1..8
+//
+// Anything on the line that isn't a valid record (e.g. the raw sense
+// dump) is passed through as text by the decoder.
+
+#include <stdint.h>
+
+#define kTelemetryBaud 115200
+
+#define kTelemetrySync 0xA5
+#define kTelemetryRecordSize 10
+
+// Number of records buffered; must be a power of two.
+#define kTelemetryRecords 16
+
+enum TelemetryType {
+  // Per-channel state, once per loop while logging is enabled.
+  kTelemetrySense = 1,
+  // A channel crossed the touch threshold.
+  kTelemetrySwitch = 2,
+  // An output was toggled in response to a touch.
+  kTelemetryToggle = 3,
+};
+
+struct TelemetryRecord {
+  uint8_t type;
+  uint8_t sequence;
+  uint8_t channel;
+  // Normally 1; more means samples went by that no record shows.
+  uint8_t samples;
+  int8_t change_count;
+  int16_t measurement;
+  int16_t impulse;
+};
+
+inline uint8_t TelemetryChecksum(const uint8_t* bytes) {
+  uint8_t sum = 0;
+  for (int i = 1; i < kTelemetryRecordSize - 1; i++) {
+    sum ^= bytes[i];
+  }
+  return sum;
+}
+
+inline void TelemetryEncode(const TelemetryRecord& record, uint8_t* bytes) {
+  bytes[0] = kTelemetrySync;
+  bytes[1] = record.type;
+  bytes[2] = record.sequence;
+  bytes[3] = (record.channel & 0x0f)
+      | ((record.samples < 15 ? record.samples : 15) << 4);
+  bytes[4] = (uint8_t)record.change_count;
+  bytes[5] = (uint16_t)record.measurement & 0xff;
+  bytes[6] = (uint16_t)record.measurement >> 8;
+  bytes[7] = (uint16_t)record.impulse & 0xff;
+  bytes[8] = (uint16_t)record.impulse >> 8;
+  bytes[9] = TelemetryChecksum(bytes);
+}
+
+// Returns false if bytes don't hold a valid record.
+inline bool TelemetryDecode(const uint8_t* bytes, TelemetryRecord* record) {
+  if (bytes[0] != kTelemetrySync
+      || bytes[kTelemetryRecordSize - 1] != TelemetryChecksum(bytes)) {
+    return false;
+  }
+  record->type = bytes[1];
+  record->sequence = bytes[2];
+  record->channel = bytes[3] & 0x0f;
+  record->samples = bytes[3] >> 4;
+  if (record->samples == 0) {
+    record->samples = 1;
+  }
+  record->change_count = (int8_t)bytes[4];
+  record->measurement = (int16_t)(bytes[5] | (bytes[6] << 8));
+  record->impulse = (int16_t)(bytes[7] | (bytes[8] << 8));
+  return true;
+}
+
+#ifdef ARDUINO
+
+uint8_t telemetryRing[kTelemetryRecords][kTelemetryRecordSize];
+uint8_t telemetryHead = 0;  // Next slot to fill.
+uint8_t telemetryTail = 0;  // Next slot to send.
+uint8_t telemetrySequence = 0;
+
+// Queues a record; never blocks.  Returns false if it had to be dropped.
+bool TelemetryLog(uint8_t type, int channel, int measurement,
+                  int impulse, int change_count, int samples = 1) {
+  if ((uint8_t)(telemetryHead - telemetryTail) == kTelemetryRecords) {
+    // Full.  Still burn a sequence number so the gap shows up.
+    telemetrySequence++;
+    return false;
+  }
+  TelemetryRecord record;
+  record.type = type;
+  record.sequence = telemetrySequence++;
+  record.channel = channel;
+  record.samples = samples;
+  record.change_count = change_count;
+  record.measurement = measurement;
+  record.impulse = impulse;
+  TelemetryEncode(record,
+                  telemetryRing[telemetryHead & (kTelemetryRecords - 1)]);
+  telemetryHead++;
+  return true;
+}
+
+// Sends as many whole records as Serial can take right now.
+void TelemetryDrain() {
+  while (telemetryTail != telemetryHead
+         && Serial.availableForWrite() >= kTelemetryRecordSize) {
+    Serial.write(telemetryRing[telemetryTail & (kTelemetryRecords - 1)],
+                 kTelemetryRecordSize);
+    telemetryTail++;
+  }
+}
+
+#endif  // ARDUINO
+
+#endif  // FURRIE_TELEMETRY_H
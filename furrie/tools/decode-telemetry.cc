@@ -0,0 +1,100 @@
+// Renders the binary telemetry written by furrie.ino back into text.
+//
+// Usage: decode-telemetry [file-or-tty]
+//
+// Reads stdin when no path is given.  Bytes that aren't part of a valid
+// record (e.g. the raw sense dump) are passed through unchanged, so the
+// output can be fed straight to the replay tool.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../telemetry.h"
+
+const char* TypeName(uint8_t type) {
+  switch (type) {
+  case kTelemetrySense:
+    return "sense";
+  case kTelemetrySwitch:
+    return "switch";
+  case kTelemetryToggle:
+    return "toggle";
+  default:
+    return "unknown";
+  }
+}
+
+int main(int argc, char** argv) {
+  FILE* in = stdin;
+  if (argc > 1) {
+    in = fopen(argv[1], "rb");
+    if (in == NULL) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  uint8_t window[kTelemetryRecordSize];
+  int filled = 0;
+  bool have_sequence = false;
+  uint8_t next_sequence = 0;
+  unsigned long records = 0;
+  unsigned long dropped = 0;
+
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    window[filled++] = c;
+    if (window[0] != kTelemetrySync) {
+      // Not the start of a record; pass it through as text.
+      fputc(window[0], stdout);
+      filled = 0;
+      continue;
+    }
+    if (filled < kTelemetryRecordSize) {
+      continue;
+    }
+
+    TelemetryRecord record;
+    if (!TelemetryDecode(window, &record)) {
+      // False sync; emit the first byte and rescan the rest.
+      fputc(window[0], stdout);
+      memmove(window, window + 1, --filled);
+      while (filled > 0 && window[0] != kTelemetrySync) {
+        fputc(window[0], stdout);
+        memmove(window, window + 1, --filled);
+      }
+      continue;
+    }
+    filled = 0;
+
+    if (have_sequence && record.sequence != next_sequence) {
+      uint8_t gap = record.sequence - next_sequence;
+      dropped += gap;
+      printf("# dropped %d records\n", gap);
+    }
+    have_sequence = true;
+    next_sequence = record.sequence + 1;
+    records++;
+
+    if (record.type == kTelemetryToggle) {
+      printf("%s ch=%d\n", TypeName(record.type), record.channel);
+    } else if (record.type == kTelemetrySense) {
+      printf("%s ch=%d meas=%d imp=%d chg=%d new=%d\n",
+             TypeName(record.type), record.channel, record.measurement,
+             record.impulse, record.change_count, record.samples);
+    } else {
+      printf("%s ch=%d meas=%d imp=%d chg=%d\n", TypeName(record.type),
+             record.channel, record.measurement, record.impulse,
+             record.change_count);
+    }
+    fflush(stdout);
+  }
+  fwrite(window, 1, filled, stdout);
+
+  fprintf(stderr, "%lu records, %lu dropped\n", records, dropped);
+  if (in != stdin) {
+    fclose(in);
+  }
+  return 0;
+}
@@ -0,0 +1,429 @@
+// Replays recorded sense data through the touch detection from furrie.ino.
+//
+// Usage: replay [options] log [onsets]
+//
+//   log     Either decode-telemetry output ("sense ch=N meas=M ...";
+//           the measurement is the filtered history value loop() sees),
+//           or the raw dump ENABLE_rawLogging prints, where every integer
+//           on a line is taken as the next sample.  Raw samples skip the
+//           library's median filtering, so expect them to be noisier.
+//   onsets  Optional; sample indices (one per line) at which a real touch
+//           started.  Without it, every trigger is just counted.
+//
+// Telemetry captures can have holes: "# dropped N records" lines where
+// the board's ring overflowed, and sense records with new=N > 1 where a
+// loop took in samples that no record shows.  The board's timeline is
+// kept across them (sample indices count the samples a hole skipped,
+// estimated from the records missing), and the replay re-syncs: nothing
+// is decided until a whole history's worth of samples has come in since
+// the hole, as if the detector had just started.  Onsets inside a hole or
+// its re-sync can't be judged and are left out of hits and misses.
+//
+// Parameters are given as lo[:hi[:step]] and every combination is run,
+// spread over all cores:
+//   -w  increaseWindow          (default 30)
+//   -p  pureIncreaseThreshold   (default 5)
+//   -1  impulseThresholdBars[1] (default 3)
+//   -2  impulseThresholdBars[2] (default 3)
+//
+// Other options:
+//   -c N  channel to take from telemetry logs (default 1)
+//   -C N  channels logged per loop (default 4), to size holes
+//   -H N  senseHistorySize on the board (default 40)
+//   -L N  loops locked out after a switch (default rawSenseSize +
+//         senseHistorySize + sortedRawWindowSize, i.e. 31 + H + 15)
+//   -m N  max samples from onset to trigger to count as a hit (default 60)
+//   -t MS milliseconds per sample, to also print latency in ms
+//   -n N  only print the N best settings (default all)
+//   -j N  worker threads (default: all cores)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../touch_detector.h"
+
+struct Range {
+  int lo;
+  int hi;
+  int step;
+};
+
+struct Config {
+  int window;
+  int pure_threshold;
+  int bars[4];
+};
+
+struct Sample {
+  int value;
+  int skipped;  // Samples lost just before this one.
+};
+
+// Stretch of the board's timeline where the replay can't decide.
+struct Span {
+  int begin;
+  int end;  // Exclusive.
+};
+
+struct Result {
+  Config config;
+  int triggers;
+  int hits;
+  int false_triggers;
+  int missed;
+  int blind;
+  double mean_latency;
+  int max_latency;
+};
+
+bool ParseRange(const char* arg, Range* range) {
+  int n = sscanf(arg, "%d:%d:%d", &range->lo, &range->hi, &range->step);
+  if (n < 1) {
+    return false;
+  }
+  if (n < 2) {
+    range->hi = range->lo;
+  }
+  if (n < 3) {
+    range->step = 1;
+  }
+  return range->step > 0 && range->hi >= range->lo;
+}
+
+// Pulls samples for `channel` out of a log file.
+//
+// Each loop logs one sense record per channel, so between two of this
+// channel's there are channels - 1 others; counting the other sense
+// records seen and the records dropped tells how many loops went
+// missing.  Each missing loop is taken as one sample, like new=1.
+bool LoadSamples(const char* path, int channel, int channels,
+                 std::vector<Sample>* samples) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[1024];
+  bool have_sample = false;
+  int between = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    int ch, meas, dropped;
+    if (strncmp(line, "sense ", 6) == 0) {
+      if (sscanf(line, "sense ch=%d meas=%d", &ch, &meas) != 2) {
+        continue;
+      }
+      if (ch != channel) {
+        between++;
+        continue;
+      }
+      Sample sample = {meas, 0};
+      const char* fresh = strstr(line, " new=");
+      if (fresh != NULL && atoi(fresh + 5) > 1) {
+        sample.skipped = atoi(fresh + 5) - 1;
+      }
+      if (have_sample) {
+        sample.skipped += std::max(0, (between + 1) / channels - 1);
+      }
+      samples->push_back(sample);
+      have_sample = true;
+      between = 0;
+      continue;
+    }
+    if (sscanf(line, "# dropped %d records", &dropped) == 1) {
+      between += dropped;
+      continue;
+    }
+    if (line[0] == '#' || strncmp(line, "switch ", 7) == 0
+        || strncmp(line, "toggle ", 7) == 0) {
+      continue;
+    }
+    // Raw dump: every integer on the line is a sample.
+    char* p = line;
+    while (*p != '\0') {
+      if ((*p >= '0' && *p <= '9')
+          || (*p == '-' && p[1] >= '0' && p[1] <= '9')) {
+        Sample sample = {(int)strtol(p, &p, 10), 0};
+        samples->push_back(sample);
+      } else {
+        p++;
+      }
+    }
+  }
+  fclose(in);
+  return true;
+}
+
+// Where each hole and the re-sync after it fall on the timeline.
+std::vector<Span> BlindSpans(const std::vector<Sample>& samples,
+                             int history_size, int* lost) {
+  std::vector<Span> spans;
+  *lost = 0;
+  int index = 0;
+  for (size_t n = 0; n < samples.size(); n++) {
+    if (samples[n].skipped > 0) {
+      Span span = {index, index + samples[n].skipped + history_size - 1};
+      if (!spans.empty() && spans.back().end >= span.begin) {
+        spans.back().end = span.end;
+      } else {
+        spans.push_back(span);
+      }
+      *lost += samples[n].skipped;
+      index += samples[n].skipped;
+    }
+    index++;
+  }
+  return spans;
+}
+
+bool LoadOnsets(const char* path, std::vector<int>* onsets) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    return false;
+  }
+  int onset;
+  while (fscanf(in, "%d", &onset) == 1) {
+    onsets->push_back(onset);
+  }
+  fclose(in);
+  std::sort(onsets->begin(), onsets->end());
+  return true;
+}
+
+// Runs one configuration over the whole log, mirroring loop().
+Result Replay(const Config& config, const std::vector<Sample>& samples,
+              const std::vector<int>& onsets, const std::vector<Span>& blind,
+              int history_size, int lockout_loops, int max_latency) {
+  Result result;
+  memset(&result, 0, sizeof(result));
+  result.config = config;
+
+  std::vector<int> history(history_size, 0);
+  int iter = 0;
+  TouchDetector detector;
+  detector.SetWindow(config.window);
+  detector.Prime(history.data(), history_size, iter);
+
+  std::vector<bool> matched(onsets.size(), false);
+  for (size_t i = 0; i < onsets.size(); i++) {
+    for (size_t b = 0; b < blind.size(); b++) {
+      if (onsets[i] >= blind[b].begin && onsets[i] < blind[b].end) {
+        matched[i] = true;
+        result.blind++;
+        break;
+      }
+    }
+  }
+  size_t first_open = 0;
+  long latency_sum = 0;
+  int switched_count = 0;
+  // Samples in a row since the last hole; the history is only whole once
+  // there are history_size of them.
+  int contiguous = history_size;
+
+  int n = -1;
+  for (size_t s = 0; s < samples.size(); s++) {
+    int skipped = samples[s].skipped;
+    if (skipped > 0) {
+      n += skipped;
+      switched_count = std::max(0, switched_count - skipped);
+      contiguous = 0;
+    }
+    n++;
+    iter = (iter + 1) % history_size;
+    history[iter] = samples[s].value;
+    if (contiguous < history_size) {
+      if (++contiguous < history_size) {
+        if (switched_count > 0) {
+          switched_count--;
+        }
+        continue;
+      }
+      detector.Prime(history.data(), history_size, iter);
+    } else {
+      detector.Push(samples[s].value);
+    }
+
+    int impulse = history[(iter + 1) % history_size] - history[iter];
+    bool past = TouchPastThreshold(detector.ChangeCount(), impulse,
+                                   config.pure_threshold, config.bars);
+    if (switched_count == 0 && past) {
+      result.triggers++;
+      switched_count = lockout_loops;
+
+      while (first_open < onsets.size()
+             && onsets[first_open] + max_latency < n) {
+        first_open++;
+      }
+      bool hit = false;
+      for (size_t i = first_open; i < onsets.size() && onsets[i] <= n;
+           i++) {
+        if (!matched[i]) {
+          matched[i] = true;
+          int latency = n - onsets[i];
+          latency_sum += latency;
+          result.max_latency = std::max(result.max_latency, latency);
+          hit = true;
+          break;
+        }
+      }
+      if (hit) {
+        result.hits++;
+      } else if (!onsets.empty()) {
+        result.false_triggers++;
+      }
+    }
+    if (switched_count > 0) {
+      switched_count--;
+    }
+  }
+
+  result.missed = onsets.size() - result.hits - result.blind;
+  if (result.hits > 0) {
+    result.mean_latency = (double)latency_sum / result.hits;
+  }
+  return result;
+}
+
+bool Better(const Result& a, const Result& b) {
+  int a_errors = a.false_triggers + a.missed;
+  int b_errors = b.false_triggers + b.missed;
+  if (a_errors != b_errors) {
+    return a_errors < b_errors;
+  }
+  return a.mean_latency < b.mean_latency;
+}
+
+void Usage() {
+  fprintf(stderr, "usage: replay [-w lo:hi:step] [-p ...] [-1 ...] [-2 ...] "
+          "[-c channel] [-C channels] [-H history] [-L lockout] [-m max_latency] "
+          "[-t ms] [-n best] [-j threads] log [onsets]\n");
+}
+
+int main(int argc, char** argv) {
+  Range window = {30, 30, 1};
+  Range pure = {5, 5, 1};
+  Range bar1 = {3, 3, 1};
+  Range bar2 = {3, 3, 1};
+  int channel = 1;
+  int channels = 4;
+  int history_size = 40;
+  int lockout_loops = -1;
+  int max_latency = 60;
+  double ms_per_sample = 0;
+  int best = 0;
+  int threads = std::thread::hardware_concurrency();
+
+  int opt;
+  while ((opt = getopt(argc, argv, "w:p:1:2:c:C:H:L:m:t:n:j:")) != -1) {
+    bool ok = true;
+    switch (opt) {
+    case 'w': ok = ParseRange(optarg, &window); break;
+    case 'p': ok = ParseRange(optarg, &pure); break;
+    case '1': ok = ParseRange(optarg, &bar1); break;
+    case '2': ok = ParseRange(optarg, &bar2); break;
+    case 'c': channel = atoi(optarg); break;
+    case 'C': channels = atoi(optarg); break;
+    case 'H': history_size = atoi(optarg); break;
+    case 'L': lockout_loops = atoi(optarg); break;
+    case 'm': max_latency = atoi(optarg); break;
+    case 't': ms_per_sample = atof(optarg); break;
+    case 'n': best = atoi(optarg); break;
+    case 'j': threads = atoi(optarg); break;
+    default: ok = false; break;
+    }
+    if (!ok) {
+      Usage();
+      return 1;
+    }
+  }
+  if (optind >= argc || history_size < 2 || channels < 1) {
+    Usage();
+    return 1;
+  }
+  if (lockout_loops < 0) {
+    lockout_loops = 31 + history_size + 15;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  std::vector<Sample> samples;
+  std::vector<int> onsets;
+  if (!LoadSamples(argv[optind], channel, channels, &samples)) {
+    return 1;
+  }
+  if (optind + 1 < argc && !LoadOnsets(argv[optind + 1], &onsets)) {
+    return 1;
+  }
+
+  std::vector<Config> configs;
+  for (int w = window.lo; w <= window.hi; w += window.step) {
+    if (w < 1 || w > kTouchMaxWindow || w >= history_size) {
+      fprintf(stderr, "skipping window %d: must be 1..%d and below the "
+              "history size\n", w, kTouchMaxWindow);
+      continue;
+    }
+    for (int p = pure.lo; p <= pure.hi; p += pure.step) {
+      for (int b1 = bar1.lo; b1 <= bar1.hi; b1 += bar1.step) {
+        for (int b2 = bar2.lo; b2 <= bar2.hi; b2 += bar2.step) {
+          Config config = {w, p, {0, b1, b2, 0}};
+          configs.push_back(config);
+        }
+      }
+    }
+  }
+
+  int lost;
+  std::vector<Span> blind = BlindSpans(samples, history_size, &lost);
+
+  std::vector<Result> results(configs.size());
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&]() {
+      size_t i;
+      while ((i = next++) < configs.size()) {
+        results[i] = Replay(configs[i], samples, onsets, blind,
+                            history_size, lockout_loops, max_latency);
+      }
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+
+  std::sort(results.begin(), results.end(), Better);
+  if (best > 0 && (size_t)best < results.size()) {
+    results.resize(best);
+  }
+
+  printf("# %zu samples, %zu onsets, %zu settings, %d threads\n",
+         samples.size(), onsets.size(), configs.size(), threads);
+  if (!blind.empty()) {
+    printf("# %zu holes, %d samples lost, %d onsets not judged\n",
+           blind.size(), lost, results.empty() ? 0 : results[0].blind);
+  }
+  printf("# window pure bar1 bar2  triggers hits false missed  "
+         "latency(mean max)\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result& r = results[i];
+    printf("%8d %4d %4d %4d  %8d %4d %5d %6d  %7.1f %3d",
+           r.config.window, r.config.pure_threshold, r.config.bars[1],
+           r.config.bars[2], r.triggers, r.hits, r.false_triggers, r.missed,
+           r.mean_latency, r.max_latency);
+    if (ms_per_sample > 0) {
+      printf("  (%.0f ms %.0f ms)", r.mean_latency * ms_per_sample,
+             r.max_latency * ms_per_sample);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+#ifndef FURRIE_TOUCH_DETECTOR_H
+#define FURRIE_TOUCH_DETECTOR_H
+
+// Incremental form of the increase-window scan in loop().
+//
+// The old scan walked the last `window` pairs of sense history on every
+// loop and counted how many of them went down (older > newer), bailing
+// out with -1 if any pair jumped up by more than 2.  Only one sample
+// arrives per loop, so the same answer can be kept up to date in O(1):
+//
+//  * rises_ is a 32-entry ring of "this diff was positive" flags, kept
+//    as a shift register; bit k is the diff k samples ago.
+//  * count_ is the number of set flags inside the window.  The flag that
+//    falls out of the window on each push is subtracted.
+//  * since_jump_ is how many samples ago the most recent big jump
+//    (diff < -2) happened; the scan would have hit it iff it is inside
+//    the window.
+//
+// ChangeCount() returns exactly what the scan would have.
+
+#include <stdint.h>
+
+#define kTouchMaxWindow 32
+
+class TouchDetector {
+public:
+  TouchDetector():
+    window_(0), count_(0), since_jump_(kNoJump), last_(0), rises_(0) {};
+
+  // window must be <= kTouchMaxWindow.
+  void SetWindow(uint8_t window) {
+    window_ = window;
+  };
+
+  // Rebuilds all state from a history ring whose newest entry is at
+  // `newest`.  This is the old O(window) scan; only needed at startup or
+  // if the ring is too short for the incremental path.
+  void Prime(const int* history, int size, int newest) {
+    count_ = 0;
+    since_jump_ = kNoJump;
+    rises_ = 0;
+    for (int steps = window_ - 1; steps >= 0; steps--) {
+      int older = history[(newest - (steps + 1) + size) % size];
+      int newer = history[(newest - steps + size) % size];
+      AddDiff(older - newer);
+    }
+    last_ = history[newest];
+  };
+
+  // Adds the newest sample.
+  void Push(int sample) {
+    AddDiff(last_ - sample);
+    last_ = sample;
+  };
+
+  int ChangeCount() const {
+    if (since_jump_ < window_) {
+      return -1;
+    }
+    return count_;
+  };
+
+private:
+  static const uint8_t kNoJump = 0xff;
+
+  void AddDiff(int diff) {
+    uint8_t rise = (diff > 0);
+    if (window_ > 0) {
+      count_ -= (rises_ >> (window_ - 1)) & 1;
+    }
+    rises_ = (rises_ << 1) | rise;
+    count_ += rise;
+
+    if (diff < -2) {
+      since_jump_ = 0;
+    } else if (since_jump_ != kNoJump) {
+      since_jump_++;
+    }
+  };
+
+  uint8_t window_;
+  uint8_t count_;
+  uint8_t since_jump_;
+  int last_;
+  uint32_t rises_;
+};
+
+// The trigger decision from loop(): enough pure decreases in the window,
+// or nearly enough plus a big enough impulse.  Kept here so the replay
+// tool makes exactly the same call as the board.
+inline bool TouchPastThreshold(int change_count, int impulse,
+                               int pure_increase_threshold,
+                               const int* impulse_threshold_bars) {
+  if (change_count >= pure_increase_threshold) {
+    return true;
+  }
+  if (change_count > pure_increase_threshold - 3) {
+    return impulse_threshold_bars[pure_increase_threshold - change_count]
+        < impulse;
+  }
+  return false;
+}
+
+#endif  // FURRIE_TOUCH_DETECTOR_H
@@ -0,0 +1,107 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+// A debounced push button, sampled from a timer interrupt so presses are
+// seen however long the sketch's frames take, and handed to loop() as
+// events.
+//
+// Sample() takes the raw pin every kButtonSampleMs.  The button's state
+// only changes after kButtonStableSamples samples in a row agree, which
+// rides out contact bounce and single-sample spikes (the state flips 10
+// ms after the contacts settle).  A press is reported when it's let go,
+// unless it was held for kButtonLongSamples, in which case it's reported
+// as a long press as soon as it has been, and not again on release; so a
+// hold never counts as a press too.
+//
+// Events go in a small ring that only Sample() writes and only Pop()
+// reads, so neither needs to turn interrupts off.  It holds
+// kButtonQueue - 1 events; if loop() falls further behind than that the
+// newest are dropped.
+
+#include <stdint.h>
+
+#define kButtonSampleMs 2
+#define kButtonStableSamples 5
+#define kButtonLongSamples (600 / kButtonSampleMs)
+#define kButtonQueue 4
+
+enum ButtonEvent {
+  kButtonPress,  // A press let go before it became long.
+  kButtonLong,   // A press held for kButtonLongSamples, still down.
+};
+
+class ButtonDebouncer {
+public:
+  ButtonDebouncer():
+    pressed_(false), agree_(0), held_(0), head_(0), tail_(0),
+    dropped_(0) {};
+
+  // The pin's reading, true when pressed; call every kButtonSampleMs.
+  void Sample(bool down) {
+    if (down != pressed_) {
+      if (++agree_ < kButtonStableSamples) {
+        Hold();
+        return;
+      }
+      agree_ = 0;
+      pressed_ = down;
+      if (pressed_) {
+        held_ = 0;
+      } else if (held_ < kButtonLongSamples) {
+        Push(kButtonPress);
+      }
+      return;
+    }
+    agree_ = 0;
+    Hold();
+  };
+
+  // Takes the oldest event, if there is one.
+  bool Pop(ButtonEvent* event) {
+    uint8_t tail = tail_;
+    if (tail == head_) {
+      return false;
+    }
+    *event = (ButtonEvent)events_[tail];
+    tail_ = (tail + 1) % kButtonQueue;
+    return true;
+  };
+
+  bool pressed() {
+    return pressed_;
+  };
+
+  // Events lost to a full queue.
+  uint16_t dropped() {
+    return dropped_;
+  };
+
+private:
+  void Hold() {
+    if (pressed_ && held_ < kButtonLongSamples) {
+      if (++held_ == kButtonLongSamples) {
+        Push(kButtonLong);
+      }
+    }
+  };
+
+  void Push(ButtonEvent event) {
+    uint8_t next = (head_ + 1) % kButtonQueue;
+    if (next == tail_) {
+      dropped_++;
+      return;
+    }
+    events_[head_] = event;
+    head_ = next;
+  };
+
+  bool pressed_;
+  uint8_t agree_;
+  uint16_t held_;
+  volatile uint8_t events_[kButtonQueue];
+  volatile uint8_t head_;
+  volatile uint8_t tail_;
+  uint16_t dropped_;
+};
+
+#endif  // BUTTON_H
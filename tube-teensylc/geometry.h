@@ -0,0 +1,58 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+// Where each LED is, for effects that draw by position (spirals, wipes,
+// rings) rather than by index.
+//
+// The positions are worked out ahead of time by tools/gen-geometry and
+// kept in flash, one LedPoint per physical LED in wiring order, so an
+// effect just looks them up: no trig or division per LED per frame.
+// Everything is a byte:
+//   x, y    across, -127..127; round the tube that's the unit circle
+//   z       along the strands, 0 at the first pixel to 255 at the last
+//   angle   round the tube's axis (or a flat panel's middle), 256 to the
+//           turn
+//   radius  from the axis, or the middle, 0..255
+// Angles wrap, so adding to one spins a pattern and adding z to it
+// twists it into a spiral.
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <avr/pgmspace.h>
+#else
+#  ifndef PROGMEM
+#    define PROGMEM
+#    define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#  endif
+#endif
+
+struct LedPoint {
+  int8_t x;
+  int8_t y;
+  uint8_t z;
+  uint8_t angle;
+  uint8_t radius;
+};
+
+inline int8_t GeometryX(const LedPoint* table, uint16_t led) {
+  return pgm_read_byte(&table[led].x);
+}
+
+inline int8_t GeometryY(const LedPoint* table, uint16_t led) {
+  return pgm_read_byte(&table[led].y);
+}
+
+inline uint8_t GeometryZ(const LedPoint* table, uint16_t led) {
+  return pgm_read_byte(&table[led].z);
+}
+
+inline uint8_t GeometryAngle(const LedPoint* table, uint16_t led) {
+  return pgm_read_byte(&table[led].angle);
+}
+
+inline uint8_t GeometryRadius(const LedPoint* table, uint16_t led) {
+  return pgm_read_byte(&table[led].radius);
+}
+
+#endif  // GEOMETRY_H
@@ -0,0 +1,213 @@
+#ifndef LPD8806_SPI_H
+#define LPD8806_SPI_H
+
+// LPD8806 output that uses the hardware SPI port whenever the data and
+// clock pins are the board's MOSI and SCK.
+//
+// Only on AVR is the frame sent in the background: the wire buffer is
+// clocked out from the SPI transfer-complete interrupt, so show() returns
+// as soon as the first byte is loaded and the sketch can render the next
+// frame while this one goes out.  Other chips with those pins, the Teensy
+// LC included, fall back to a blocking SPI.transfer() per byte, so there
+// show() returns once the frame is out.  On any other pins (or on chips
+// without an SPI port, such as the ATtiny85) it bit-bangs via the port
+// registers.
+//
+// The buffer holds `num_pixels` pixels and goes out `copies` times in a
+// row.  dstrand-waterfall shows the same pattern on all nSTRIPS strands,
+// so it keeps one copy of a strand and sends it 8 times: 66 bytes
+// instead of the library's 528 for 22 x 8.  tube-teensylc draws every
+// LED of the tube itself (kGeometryLeds, 1 copy), so its buffer is the
+// full 528 bytes.
+//
+// There's one interrupt per byte.  With the SPI clock at F_CPU / 16 a
+// byte takes 128 cycles, and what the interrupt leaves of them to loop()
+// hasn't been measured yet (avr-bench's spi-bench reports it once run
+// under simavr).  Faster dividers finish sooner but leave less, and at
+// some point polling would be better.
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#if defined(SPDR) || !defined(__AVR__)
+#  define LPD8806_SPI_HARDWARE 1
+#  include <SPI.h>
+#endif
+
+#ifndef LPD8806_SPI_CLOCK
+#  define LPD8806_SPI_CLOCK SPI_CLOCK_DIV16
+#endif
+
+#if defined(__AVR__) && defined(SPDR)
+#  define LPD8806_SPI_INTERRUPT 1
+#endif
+
+// Transmit state shared with the interrupt handler.
+const uint8_t* volatile lpdTxNext = NULL;
+const uint8_t* volatile lpdTxStart = NULL;
+const uint8_t* volatile lpdTxEnd = NULL;
+volatile uint8_t lpdTxCopies = 0;
+volatile uint8_t lpdTxLatch = 0;
+volatile bool lpdTxBusy = false;
+
+#ifdef LPD8806_SPI_INTERRUPT
+ISR(SPI_STC_vect) {
+  if (lpdTxNext == lpdTxEnd && lpdTxCopies > 1) {
+    lpdTxCopies--;
+    lpdTxNext = lpdTxStart;
+  }
+  if (lpdTxNext != lpdTxEnd) {
+    SPDR = *lpdTxNext++;
+  } else if (lpdTxLatch > 0) {
+    lpdTxLatch--;
+    SPDR = 0;
+  } else {
+    // Hand the port back so SPI.transfer() works for anyone else.
+    SPCR &= ~_BV(SPIE);
+    lpdTxBusy = false;
+  }
+}
+#endif
+
+class Lpd8806Spi {
+public:
+  Lpd8806Spi(uint16_t num_pixels, uint8_t copies,
+             uint8_t data_pin, uint8_t clock_pin):
+    num_pixels_(num_pixels),
+    copies_(copies),
+    data_pin_(data_pin),
+    clock_pin_(clock_pin),
+#ifdef LPD8806_SPI_HARDWARE
+    hardware_(data_pin == MOSI && clock_pin == SCK),
+#else
+    hardware_(false),
+#endif
+    pixels_((uint8_t*)malloc(num_pixels * 3)) {
+    if (pixels_ == NULL) {
+      return;
+    }
+    for (uint16_t i = 0; i < num_pixels * 3; i++) {
+      pixels_[i] = 0x80;
+    }
+  };
+
+  // Without the RAM for the buffer, nothing is ever sent.
+  void begin() {
+    if (pixels_ == NULL) {
+      return;
+    }
+    if (hardware_) {
+#ifdef LPD8806_SPI_HARDWARE
+      SPI.begin();
+      SPI.setBitOrder(MSBFIRST);
+      SPI.setDataMode(SPI_MODE0);
+      SPI.setClockDivider(LPD8806_SPI_CLOCK);
+#endif
+    } else {
+      pinMode(data_pin_, OUTPUT);
+      pinMode(clock_pin_, OUTPUT);
+      data_port_ = portOutputRegister(digitalPinToPort(data_pin_));
+      data_mask_ = digitalPinToBitMask(data_pin_);
+      clock_port_ = portOutputRegister(digitalPinToPort(clock_pin_));
+      clock_mask_ = digitalPinToBitMask(clock_pin_);
+    }
+    // The strip latches on a run of zero bytes.
+    for (uint8_t i = LatchBytes(); i > 0; i--) {
+      WriteByte(0);
+    }
+  };
+
+  bool usingHardware() {
+    return hardware_;
+  };
+
+  uint16_t numPixels() {
+    return num_pixels_;
+  };
+
+  // Same layout as the LPD8806 library: G, R, B with the high bit set.
+  // Don't call while busy(); the frame in flight would tear.
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+    if (n < num_pixels_ && pixels_ != NULL) {
+      uint8_t* p = &pixels_[n * 3];
+      *p++ = g | 0x80;
+      *p++ = r | 0x80;
+      *p = b | 0x80;
+    }
+  };
+
+  bool busy() {
+    return lpdTxBusy;
+  };
+
+  void waitForShow() {
+    while (lpdTxBusy) {
+    }
+  };
+
+  // Starts sending the buffer.  With the interrupt path this returns
+  // right away; otherwise once the frame is out.
+  void show() {
+    if (pixels_ == NULL) {
+      return;
+    }
+    waitForShow();
+#ifdef LPD8806_SPI_INTERRUPT
+    if (hardware_) {
+      lpdTxStart = pixels_;
+      lpdTxEnd = pixels_ + num_pixels_ * 3;
+      lpdTxNext = lpdTxStart + 1;
+      lpdTxCopies = copies_;
+      lpdTxLatch = LatchBytes();
+      lpdTxBusy = true;
+      SPCR |= _BV(SPIE);
+      SPDR = pixels_[0];
+      return;
+    }
+#endif
+    for (uint8_t copy = 0; copy < copies_; copy++) {
+      for (uint16_t i = 0; i < num_pixels_ * 3; i++) {
+        WriteByte(pixels_[i]);
+      }
+    }
+    for (uint8_t i = LatchBytes(); i > 0; i--) {
+      WriteByte(0);
+    }
+  };
+
+private:
+  uint8_t LatchBytes() {
+    return ((uint32_t)num_pixels_ * copies_ + 31) / 32;
+  };
+
+  void WriteByte(uint8_t value) {
+#ifdef LPD8806_SPI_HARDWARE
+    if (hardware_) {
+      SPI.transfer(value);
+      return;
+    }
+#endif
+    for (uint8_t bit = 0x80; bit; bit >>= 1) {
+      if (value & bit) {
+        *data_port_ |= data_mask_;
+      } else {
+        *data_port_ &= ~data_mask_;
+      }
+      *clock_port_ |= clock_mask_;
+      *clock_port_ &= ~clock_mask_;
+    }
+  };
+
+  uint16_t num_pixels_;
+  uint8_t copies_;
+  uint8_t data_pin_;
+  uint8_t clock_pin_;
+  bool hardware_;
+  uint8_t* pixels_;
+  volatile uint8_t* data_port_;
+  uint8_t data_mask_;
+  volatile uint8_t* clock_port_;
+  uint8_t clock_mask_;
+};
+
+#endif  // LPD8806_SPI_H
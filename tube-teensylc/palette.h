@@ -0,0 +1,143 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+// Color palettes for the tube's effects: 16 key colors, spread round a
+// 256-step ring, that the effects index with a byte.
+//
+// The keys are expanded into all 256 colors once, when the palette
+// changes, so drawing a pixel is one table lookup: no interpolation or
+// division per LED per frame.  Changing palette doesn't cut: the keys
+// step towards the new palette's a little every frame (Step()) and the
+// table is only expanded again on frames where they moved, so a palette
+// at rest costs nothing.
+//
+// Keys live in flash.  Nothing here needs Arduino, so tools/palette-bench
+// builds it on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#  include <avr/pgmspace.h>
+#else
+#  ifndef PROGMEM
+#    define PROGMEM
+#    define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#  endif
+#endif
+
+#define kPaletteKeys 16
+#define kPaletteSize 256
+
+struct PaletteColor {
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+};
+
+class PaletteBlender {
+public:
+  PaletteBlender():
+    target_(NULL), blending_(false), expansions_(0) {};
+
+  // Switches to `keys` at once; for the first palette.
+  void Load(const PaletteColor* keys) {
+    target_ = keys;
+    for (uint8_t i = 0; i < kPaletteKeys; i++) {
+      current_[i] = Key(i);
+    }
+    blending_ = false;
+    Expand();
+  };
+
+  // Starts blending towards `keys`.  Asking for the palette already
+  // being shown or blended to does nothing.
+  void SetTarget(const PaletteColor* keys) {
+    if (keys != target_) {
+      target_ = keys;
+      blending_ = true;
+    }
+  };
+
+  // Moves every key channel up to `most` closer to the target; call once
+  // a frame.  Returns true while the blend is still going.
+  bool Step(uint8_t most) {
+    if (!blending_) {
+      return false;
+    }
+    bool moved = false;
+    for (uint8_t i = 0; i < kPaletteKeys; i++) {
+      PaletteColor key = Key(i);
+      moved |= Toward(&current_[i].red, key.red, most);
+      moved |= Toward(&current_[i].green, key.green, most);
+      moved |= Toward(&current_[i].blue, key.blue, most);
+    }
+    if (moved) {
+      Expand();
+    }
+    blending_ = moved;
+    return moved;
+  };
+
+  const PaletteColor& At(uint8_t index) {
+    return colors_[index];
+  };
+
+  bool blending() {
+    return blending_;
+  };
+
+  // How many times the table has been rebuilt.
+  uint32_t expansions() {
+    return expansions_;
+  };
+
+private:
+  PaletteColor Key(uint8_t i) {
+    PaletteColor key;
+    key.red = pgm_read_byte(&target_[i].red);
+    key.green = pgm_read_byte(&target_[i].green);
+    key.blue = pgm_read_byte(&target_[i].blue);
+    return key;
+  };
+
+  static bool Toward(uint8_t* value, uint8_t target, uint8_t most) {
+    if (*value == target) {
+      return false;
+    }
+    if (*value < target) {
+      *value = target - *value > most ? *value + most : target;
+    } else {
+      *value = *value - target > most ? *value - most : target;
+    }
+    return true;
+  };
+
+  static uint8_t Mix(uint8_t from, uint8_t to, uint8_t step) {
+    return (from * (16 - step) + to * step) >> 4;
+  };
+
+  // Straight lines between the keys, the last running back to the first.
+  void Expand() {
+    PaletteColor* out = colors_;
+    for (uint8_t i = 0; i < kPaletteKeys; i++) {
+      const PaletteColor& from = current_[i];
+      const PaletteColor& to = current_[(i + 1) % kPaletteKeys];
+      for (uint8_t step = 0; step < kPaletteSize / kPaletteKeys; step++) {
+        out->red = Mix(from.red, to.red, step);
+        out->green = Mix(from.green, to.green, step);
+        out->blue = Mix(from.blue, to.blue, step);
+        out++;
+      }
+    }
+    expansions_++;
+  };
+
+  const PaletteColor* target_;
+  bool blending_;
+  uint32_t expansions_;
+  PaletteColor current_[kPaletteKeys];
+  PaletteColor colors_[kPaletteSize];
+};
+
+#endif  // PALETTE_H
@@ -0,0 +1,248 @@
+// Runs ButtonDebouncer against simulated bouncy presses and measures how
+// long a press takes to change the tube's mode, against reading the pin
+// once a frame with the same short and long rules.
+//
+// Usage: button-sim [-f frame-ms] [-n presses] [-s seed]
+//
+//   -f N  frame time in ms, draw + show + delay (default 6, the tube's
+//         4 ms delay plus sending 176 LEDs)
+//   -n N  presses per pattern (default 1000)
+//   -s N  random seed (default 1)
+//
+// For each pattern prints short presses detected, missed and extra, and
+// the latency from the contacts first opening to loop() acting on the
+// press; and the same for long presses, from when the hold became long.
+// A hold that also gives a short press counts as an extra.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../button.h"
+
+#define kButtonLongUs (kButtonLongSamples * kButtonSampleMs * 1000)
+
+struct Edge {
+  int64_t us;
+  bool down;
+};
+
+struct Press {
+  int64_t start_us;
+  int64_t length_us;
+  bool long_press;
+};
+
+struct Pattern {
+  const char* name;
+  int min_ms, max_ms;  // Press length.
+  int bounce_us;       // Chatter after each make and break, at most.
+  bool spikes;         // Stray one-sample glitches between presses.
+};
+
+const Pattern kPatterns[] = {
+  {"clean taps", 30, 120, 0, false},
+  {"bouncy taps", 30, 120, 5000, false},
+  {"short bouncy taps", 12, 30, 3000, false},
+  {"noisy line", 30, 120, 5000, true},
+  {"long holds", 800, 1500, 5000, false},
+};
+
+int64_t Random(int64_t low, int64_t high) {
+  return low + (int64_t)(rand() % (high - low + 1));
+}
+
+// Toggles the contacts for up to bounce_us after `us`, ending at `down`.
+void Bounce(std::vector<Edge>* edges, int64_t us, bool down, int bounce_us) {
+  bool level = down;
+  edges->push_back({us, level});
+  int64_t end = us + (bounce_us > 0 ? Random(0, bounce_us) : 0);
+  for (int64_t t = us + Random(50, 500); t < end; t += Random(50, 500)) {
+    level = !level;
+    edges->push_back({t, level});
+  }
+  if (level != down) {
+    edges->push_back({end, down});
+  }
+}
+
+bool LevelAt(const std::vector<Edge>& edges, size_t* cursor, int64_t us) {
+  while (*cursor + 1 < edges.size() && edges[*cursor + 1].us <= us) {
+    (*cursor)++;
+  }
+  return *cursor < edges.size() && edges[*cursor].us <= us
+      ? edges[*cursor].down : false;
+}
+
+struct Result {
+  int detected = 0;
+  int missed = 0;
+  int extra = 0;
+  std::vector<int64_t> latency_us;
+};
+
+void Print(const char* how, Result& result) {
+  std::sort(result.latency_us.begin(), result.latency_us.end());
+  size_t n = result.latency_us.size();
+  double mean = 0;
+  for (int64_t us : result.latency_us) {
+    mean += us;
+  }
+  printf("  %-11s %5d ok %5d missed %5d extra", how, result.detected,
+         result.missed, result.extra);
+  if (n > 0) {
+    printf("   latency ms: mean %5.1f  p95 %5.1f  max %5.1f",
+           mean / n / 1000, result.latency_us[n * 95 / 100] / 1000.0,
+           result.latency_us[n - 1] / 1000.0);
+  }
+  printf("\n");
+}
+
+// Matches each event to the press it belongs to: the latest press that
+// started before it, if it hasn't been matched already.  `held` scores
+// the long press events against the presses long enough for one, and
+// otherwise the short press events against the rest.
+void Score(const std::vector<Press>& presses,
+           const std::vector<std::pair<int64_t, bool> >& events, bool held,
+           Result* result) {
+  std::vector<bool> seen(presses.size(), false);
+  int expected = 0;
+  for (const Press& press : presses) {
+    expected += press.long_press == held;
+  }
+  for (const auto& event : events) {
+    if (event.second != held) {
+      continue;
+    }
+    size_t i = std::upper_bound(presses.begin(), presses.end(), event.first,
+                                [](int64_t us, const Press& press) {
+                                  return us < press.start_us;
+                                }) - presses.begin();
+    if (i == 0 || seen[i - 1] || presses[i - 1].long_press != held) {
+      result->extra++;
+      continue;
+    }
+    const Press& press = presses[i - 1];
+    seen[i - 1] = true;
+    result->detected++;
+    int64_t from = press.start_us
+        + (held ? kButtonLongUs : press.length_us);
+    result->latency_us.push_back(event.first - from);
+  }
+  result->missed = expected - result->detected;
+}
+
+void Run(const Pattern& pattern, int count, int frame_ms) {
+  std::vector<Edge> edges;
+  std::vector<Press> presses;
+  edges.push_back({0, false});
+  int64_t us = Random(100000, 300000);
+  for (int i = 0; i < count; i++) {
+    int64_t length = Random(pattern.min_ms, pattern.max_ms) * 1000;
+    presses.push_back({us, length,
+                       length >= kButtonLongUs});
+    Bounce(&edges, us, true, pattern.bounce_us);
+    Bounce(&edges, us + length, false, pattern.bounce_us);
+    us += length + Random(300000, 700000);
+    if (pattern.spikes) {
+      // A 100 us glitch somewhere in the gap.
+      int64_t at = us - Random(100000, 250000);
+      edges.push_back({at, true});
+      edges.push_back({at + 100, false});
+    }
+  }
+  std::sort(edges.begin(), edges.end(),
+            [](const Edge& a, const Edge& b) { return a.us < b.us; });
+  int64_t end = us + 1000000;
+
+  // Debounced: sampled from the timer, events taken after each frame.
+  ButtonDebouncer button;
+  std::vector<std::pair<int64_t, bool> > debounced;
+  int64_t sample_us = Random(0, kButtonSampleMs * 1000);
+  int64_t frame_us = Random(0, frame_ms * 1000);
+  size_t cursor = 0;
+  while (frame_us < end) {
+    while (sample_us <= frame_us) {
+      button.Sample(LevelAt(edges, &cursor, sample_us));
+      sample_us += kButtonSampleMs * 1000;
+    }
+    ButtonEvent event;
+    while (button.Pop(&event)) {
+      debounced.push_back({frame_us, event == kButtonLong});
+    }
+    frame_us += frame_ms * 1000;
+  }
+
+  // Polled: the pin read once a frame, a press on every release unless
+  // it had been low for a long press.
+  std::vector<std::pair<int64_t, bool> > polled;
+  cursor = 0;
+  bool was_down = false;
+  bool was_long = false;
+  int64_t down_us = 0;
+  for (frame_us = Random(0, frame_ms * 1000); frame_us < end;
+       frame_us += frame_ms * 1000) {
+    bool down = LevelAt(edges, &cursor, frame_us);
+    if (down && !was_down) {
+      down_us = frame_us;
+      was_long = false;
+    } else if (down && !was_long && frame_us - down_us >= kButtonLongUs) {
+      polled.push_back({frame_us, true});
+      was_long = true;
+    } else if (!down && was_down && !was_long) {
+      polled.push_back({frame_us, false});
+    }
+    was_down = down;
+  }
+
+  printf("%s (%d-%d ms, bounce up to %d us%s):\n", pattern.name,
+         pattern.min_ms, pattern.max_ms, pattern.bounce_us,
+         pattern.spikes ? ", glitches" : "");
+  const char* kinds[][2] = {{"debounced", "held"}, {"polled", "polled held"}};
+  const std::vector<std::pair<int64_t, bool> >* runs[] = {&debounced,
+                                                          &polled};
+  for (int run = 0; run < 2; run++) {
+    for (int held = 0; held < 2; held++) {
+      Result result;
+      Score(presses, *runs[run], held, &result);
+      if (result.detected + result.missed + result.extra > 0) {
+        Print(kinds[run][held], result);
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  int frame_ms = 6;
+  int count = 1000;
+  int seed = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:n:s:")) != -1) {
+    switch (opt) {
+    case 'f': frame_ms = atoi(optarg); break;
+    case 'n': count = atoi(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: button-sim [-f frame-ms] [-n presses] "
+              "[-s seed]\n");
+      return 1;
+    }
+  }
+  if (frame_ms < 1 || count < 1) {
+    fprintf(stderr, "usage: button-sim [-f frame-ms] [-n presses] "
+            "[-s seed]\n");
+    return 1;
+  }
+  srand(seed);
+
+  printf("%d ms frames, sampled every %d ms\n", frame_ms, kButtonSampleMs);
+  for (const Pattern& pattern : kPatterns) {
+    Run(pattern, count, frame_ms);
+  }
+  return 0;
+}
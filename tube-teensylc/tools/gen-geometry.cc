@@ -0,0 +1,114 @@
+// Writes the LED coordinate table in geometry.h's format, so the sketch
+// never does trig or division to find where an LED is.
+//
+// Usage: gen-geometry [-f] [-s] [-o file] strands pixels
+//
+//   -f      the strands hang side by side on a flat panel instead of
+//           round a tube
+//   -s      odd strands run the other way (serpentine wiring)
+//   -o F    output file (default stdout)
+//
+// The sketch's table is tube_geometry.h, from
+//   tools/gen-geometry -o tube_geometry.h 8 22
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int Round(double value) {
+  return (int)floor(value + 0.5);
+}
+
+// 0..255 for a full turn, counterclockwise from +x.
+int Angle(double x, double y) {
+  double turns = atan2(y, x) / (2 * M_PI);
+  if (turns < 0) {
+    turns += 1;
+  }
+  return Round(turns * 256) & 0xff;
+}
+
+int main(int argc, char** argv) {
+  bool flat = false;
+  bool serpentine = false;
+  const char* output = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fso:")) != -1) {
+    switch (opt) {
+    case 'f':
+      flat = true;
+      break;
+    case 's':
+      serpentine = true;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-f] [-s] [-o file] strands pixels\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-f] [-s] [-o file] strands pixels\n",
+            argv[0]);
+    return 1;
+  }
+  int strands = atoi(argv[optind]);
+  int pixels = atoi(argv[optind + 1]);
+  if (strands < 1 || pixels < 2 || strands * pixels > 4096) {
+    fprintf(stderr, "want 1 or more strands of 2 or more pixels, at most "
+            "4096 in all\n");
+    return 1;
+  }
+
+  FILE* out = stdout;
+  if (output != NULL) {
+    out = fopen(output, "w");
+    if (out == NULL) {
+      perror(output);
+      return 1;
+    }
+  }
+
+  fprintf(out, "// Generated by tools/gen-geometry %s%s%d %d; do not edit.\n",
+          flat ? "-f " : "", serpentine ? "-s " : "", strands, pixels);
+  fprintf(out, "\n#include \"geometry.h\"\n\n");
+  fprintf(out, "#define kGeometryLeds %d\n\n", strands * pixels);
+  fprintf(out, "const LedPoint kGeometry[kGeometryLeds] PROGMEM = {\n");
+  // The farthest an LED is from the middle of a flat panel.
+  double far = hypot(strands > 1 ? 1.0 : 0.0, 1.0);
+  for (int strand = 0; strand < strands; strand++) {
+    for (int i = 0; i < pixels; i++) {
+      int along = serpentine && (strand & 1) ? pixels - 1 - i : i;
+      double z = (double)along / (pixels - 1);
+      int x, y, angle, radius;
+      if (flat) {
+        // -1..1 across and along, about the middle of the panel.
+        double across = strands > 1 ? 2.0 * strand / (strands - 1) - 1 : 0;
+        double up = 2 * z - 1;
+        x = Round(across * 127);
+        y = 0;
+        angle = Angle(across, up);
+        radius = Round(hypot(across, up) / far * 255);
+      } else {
+        double turn = 2 * M_PI * strand / strands;
+        x = Round(cos(turn) * 127);
+        y = Round(sin(turn) * 127);
+        angle = strand * 256 / strands;
+        radius = 255;
+      }
+      fprintf(out, "  {%4d, %4d, %3d, %3d, %3d},\n", x, y, Round(z * 255),
+              angle, radius);
+    }
+  }
+  fprintf(out, "};\n");
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,178 @@
+// Checks the palette blender and times palette lookups against working
+// out the wheel colors per pixel, as the tube's effects used to.
+//
+// Usage: palette-bench [-f frames]
+//
+//   -f N  frames to time (default 100000)
+//
+// Prints the time per 176-LED frame both ways and per table expansion.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../palette.h"
+
+#define kLeds 176
+
+// volatile so the timed loops aren't folded away.
+volatile uint8_t out[kLeds * 3];
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+const PaletteColor kRamp[kPaletteKeys] = {
+  {  0,   0,   0}, { 16,   8,   0}, { 32,  16,   0}, { 48,  24,   0},
+  { 64,  32,   0}, { 80,  40,   0}, { 96,  48,   0}, {112,  56,   0},
+  {127,  64,   0}, {112,  56,   0}, { 96,  48,   0}, { 80,  40,   0},
+  { 64,  32,   0}, { 48,  24,   0}, { 32,  16,   0}, { 16,   8,   0},
+};
+
+const PaletteColor kBlues[kPaletteKeys] = {
+  {  0,   0,  96}, {  4,   0,  88}, {  8,   0,  80}, { 12,   0,  72},
+  { 16,   0,  64}, { 20,   0,  56}, { 24,   0,  48}, { 28,   0,  40},
+  { 32,   0,  32}, { 28,   0,  40}, { 24,   0,  48}, { 20,   0,  56},
+  { 16,   0,  64}, { 12,   0,  72}, {  8,   0,  80}, {  4,   0,  88},
+};
+
+// The old per-pixel rainbow.
+PaletteColor Wheel(uint16_t position) {
+  PaletteColor color;
+  uint8_t along = position % 128;
+  switch (position / 128) {
+  case 0:
+    color.red = 127 - along;
+    color.green = along;
+    color.blue = 0;
+    break;
+  case 1:
+    color.red = 0;
+    color.green = 127 - along;
+    color.blue = along;
+    break;
+  default:
+    color.red = along;
+    color.green = 0;
+    color.blue = 127 - along;
+    break;
+  }
+  return color;
+}
+
+bool Same(const PaletteColor& a, const PaletteColor& b) {
+  return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+// The keys land where they should, a blend ends on the target's table
+// within the promised number of frames, and nothing is rebuilt at rest.
+int Check() {
+  int failures = 0;
+  PaletteBlender blender;
+  blender.Load(kRamp);
+  for (int i = 0; i < kPaletteKeys; i++) {
+    if (!Same(blender.At(i * kPaletteSize / kPaletteKeys), kRamp[i])) {
+      fprintf(stderr, "key %d isn't at its index\n", i);
+      failures++;
+    }
+  }
+  PaletteBlender blues;
+  blues.Load(kBlues);
+
+  const int kStep = 8;
+  blender.SetTarget(kBlues);
+  int frames = 0;
+  while (blender.Step(kStep)) {
+    frames++;
+  }
+  if (frames > (127 + kStep - 1) / kStep) {
+    fprintf(stderr, "blend took %d frames\n", frames);
+    failures++;
+  }
+  for (int i = 0; i < kPaletteSize; i++) {
+    if (!Same(blender.At(i), blues.At(i))) {
+      fprintf(stderr, "blend ended off the target at %d\n", i);
+      failures++;
+      break;
+    }
+  }
+  uint32_t expansions = blender.expansions();
+  blender.SetTarget(kBlues);
+  for (int f = 0; f < 100; f++) {
+    blender.Step(kStep);
+  }
+  if (blender.expansions() != expansions) {
+    fprintf(stderr, "rebuilt the table at rest\n");
+    failures++;
+  }
+  printf("blend: %d frames, %u expansions\n", frames,
+         (unsigned)(expansions - 1));
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  int frames = 100000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:")) != -1) {
+    switch (opt) {
+    case 'f': frames = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: palette-bench [-f frames]\n");
+      return 1;
+    }
+  }
+  if (frames < 1) {
+    fprintf(stderr, "usage: palette-bench [-f frames]\n");
+    return 1;
+  }
+
+  if (Check() > 0) {
+    return 1;
+  }
+
+  volatile uint16_t leds = kLeds;
+
+  double start = Now();
+  for (int f = 0; f < frames; f++) {
+    for (uint16_t i = 0; i < leds; i++) {
+      PaletteColor color = Wheel((i * 384 / leds + f) % 384);
+      out[i * 3] = color.red;
+      out[i * 3 + 1] = color.green;
+      out[i * 3 + 2] = color.blue;
+    }
+  }
+  double wheel = (Now() - start) / frames;
+
+  PaletteBlender blender;
+  blender.Load(kRamp);
+  uint8_t offsets[kLeds];
+  for (uint16_t i = 0; i < kLeds; i++) {
+    offsets[i] = i * kPaletteSize / kLeds;
+  }
+  start = Now();
+  for (int f = 0; f < frames; f++) {
+    for (uint16_t i = 0; i < leds; i++) {
+      const PaletteColor& color = blender.At(offsets[i] + f);
+      out[i * 3] = color.red;
+      out[i * 3 + 1] = color.green;
+      out[i * 3 + 2] = color.blue;
+    }
+  }
+  double lookup = (Now() - start) / frames;
+
+  start = Now();
+  for (int f = 0; f < frames; f++) {
+    blender.Load(f & 1 ? kRamp : kBlues);
+  }
+  double expand = (Now() - start) / frames;
+
+  printf("per %d-LED frame: wheel %.2f us, palette %.2f us; "
+         "expansion %.2f us\n", kLeds, wheel * 1e6, lookup * 1e6,
+         expand * 1e6);
+  return 0;
+}
@@ -1,5 +1,8 @@
-#include "LPD8806.h"
 #include "SPI.h" // Comment out this line if using Trinket or Gemma
+#include "button.h"
+#include "lpd8806_spi.h"
+#include "palette.h"
+#include "tube_geometry.h"
 #ifdef __AVR__
   #include <avr/power.h>
 #endif
@@ -23,6 +26,10 @@ typedef uint8_t byte;
 int dataPin  = 11;
 int clockPin = 13;
 
+// A push button to ground: a press moves on to the next mode, and
+// holding it stops (or restarts) the modes changing by themselves.
+#define BUTTON_PIN 2
+
 
 class ColorTuple {
 public:
@@ -77,8 +84,16 @@ public:
     return size_;
   };
 
+  // The same pixel on every strand.
   void setPixelColor(const byte& pixel, const class Color& color) {
-    pixels_[pixel] = color;
+    for (uint16_t led = pixel; led < kGeometryLeds; led += nLEDS) {
+      pixels_[led] = color;
+    }
+  };
+
+  // One LED, by its index in kGeometry.
+  void setLedColor(uint16_t led, const class Color& color) {
+    pixels_[led] = color;
   };
 
   virtual void begin() = 0;
@@ -86,16 +101,15 @@ public:
 
 protected:
   byte size_;
-  class Color pixels_[nLEDS];
+  class Color pixels_[kGeometryLeds];
 
 };
 
 class ArduinoStrip: public Strip {
 public:
   ArduinoStrip(byte size):
-    Strip(size) {
-    strip_ = LPD8806(nLEDS * nSTRIPS, dataPin, clockPin);
-
+    Strip(size),
+    strip_(kGeometryLeds, 1, dataPin, clockPin) {
   };
 
   virtual void begin() {
@@ -103,7 +117,9 @@ public:
   };
 
   virtual void show() {
-    for (unsigned int i = 0; i < size_; i++) {
+    // The previous frame may still be going out.
+    strip_.waitForShow();
+    for (unsigned int i = 0; i < kGeometryLeds; i++) {
       SetPixelColor(i);
     }
     strip_.show();
@@ -111,25 +127,21 @@ public:
 
 private:
   void SetPixelColor(short pixel) {
-    for (int i = 0; i < nSTRIPS; i++) {
-      byte red = pixels_[pixel].GetRed() * kStripScale;
-      byte blue = pixels_[pixel].GetBlue() * kStripScale;
-      byte green = pixels_[pixel].GetGreen() * kStripScale;
-
-      if (kSwapBlueGreen) {
-        strip_.setPixelColor(pixel + (nLEDS * i),
-                             strip_.Color(red, blue, green));
-      } else {
-        strip_.setPixelColor(pixel + (nLEDS * i),
-                             strip_.Color(red, green, blue));
-      }
+    byte red = pixels_[pixel].GetRed() * kStripScale;
+    byte blue = pixels_[pixel].GetBlue() * kStripScale;
+    byte green = pixels_[pixel].GetGreen() * kStripScale;
+
+    if (kSwapBlueGreen) {
+      strip_.setPixelColor(pixel, red, blue, green);
+    } else {
+      strip_.setPixelColor(pixel, red, green, blue);
     }
   };
 
-  // First parameter is the number of LEDs in the strand.  The LED strips
-  // are 32 LEDs per meter but you can extend or cut the strip.  Next two
-  // parameters are SPI data and clock pins:
-  LPD8806 strip_;
+  // Every strand gets its own pixels, so effects can draw by position
+  // round the tube.  Pins 11 and 13 are hardware SPI, so show() only
+  // starts the transfer.
+  Lpd8806Spi strip_;
   
 };
 
@@ -164,6 +176,94 @@ Strip* CreateStrip(byte num_leds) {
   return new ArduinoStrip(num_leds);
 }
 
+uint32_t iterations = 0;
+
+// The palettes, sampled from the wheel functions the effects used to
+// call per pixel.  The rainbow goes r - g - b - back to r.
+const PaletteColor kRainbowPalette[kPaletteKeys] PROGMEM = {
+  {127,   0,   0}, {103,  24,   0}, { 79,  48,   0}, { 55,  72,   0},
+  { 31,  96,   0}, {  7, 120,   0}, {  0, 111,  16}, {  0,  87,  40},
+  {  0,  63,  64}, {  0,  39,  88}, {  0,  15, 112}, {  8,   0, 119},
+  { 32,   0,  95}, { 56,   0,  71}, { 80,   0,  47}, {104,   0,  23},
+};
+
+const PaletteColor kRedYellowPalette[kPaletteKeys] PROGMEM = {
+  {127,   0,   0}, {119,   2,   0}, {111,   5,   0}, {103,   8,   0},
+  { 95,  10,   0}, { 87,  13,   0}, { 79,  16,   0}, { 71,  18,   0},
+  { 64,  21,   0}, { 72,  18,   0}, { 80,  16,   0}, { 88,  13,   0},
+  { 96,  10,   0}, {104,   8,   0}, {112,   5,   0}, {120,   2,   0},
+};
+
+const PaletteColor kBluePalette[kPaletteKeys] PROGMEM = {
+  {  0,   0,  96}, {  4,   0,  88}, {  8,   0,  80}, { 12,   0,  72},
+  { 16,   0,  64}, { 20,   0,  56}, { 24,   0,  48}, { 28,   0,  40},
+  { 32,   0,  32}, { 28,   0,  40}, { 24,   0,  48}, { 20,   0,  56},
+  { 16,   0,  64}, { 12,   0,  72}, {  8,   0,  80}, {  4,   0,  88},
+};
+
+// The effect loop() runs, and the palette it draws with.
+enum LedMode {
+  kModeRainbow,
+  kModeRedYellow,
+  kModeBlue,
+  kModeSpiral,
+  kModeWipe,
+  kModeCount,
+};
+
+const PaletteColor* const kModePalettes[kModeCount] = {
+  kRainbowPalette, kRedYellowPalette, kBluePalette, kRainbowPalette,
+  kRedYellowPalette,
+};
+
+// Largest change to a palette key's channel per frame when blending to
+// the next mode's palette; 8 takes at most 16 frames.
+#define kPaletteBlendStep 8
+
+PaletteBlender palette;
+byte ledMode = kModeCount;
+
+// Cleared by a long press, to stay in one mode.
+bool autoAdvance = true;
+// Set when the button changes the mode, so the effect drawing stops
+// there instead of finishing its cycle.
+bool modeChanged = false;
+
+ButtonDebouncer button;
+
+void SampleButton() {
+  button.Sample(digitalRead(BUTTON_PIN) == LOW);
+}
+
+// Sampled from a timer so presses are seen in the middle of frames too.
+#if defined(TEENSYDUINO)
+IntervalTimer buttonTimer;
+#elif defined(__AVR__)
+// Timer0 already ticks every 1.024 ms for millis(); its compare B match
+// is spare.
+ISR(TIMER0_COMPB_vect) {
+  static byte ticks = 0;
+  if (++ticks == kButtonSampleMs) {
+    ticks = 0;
+    SampleButton();
+  }
+}
+#endif
+
+void StartButton() {
+  pinMode(BUTTON_PIN, INPUT_PULLUP);
+#if defined(TEENSYDUINO)
+  buttonTimer.begin(SampleButton, kButtonSampleMs * 1000);
+#elif defined(__AVR__)
+  OCR0B = 0x80;
+  TIMSK0 |= _BV(OCIE0B);
+#endif
+}
+
+// Where each pixel along a strand starts in the palette, spreading the
+// whole palette along the strand.
+byte paletteOffsets[nLEDS];
+
 void setup() {
 #if defined(__AVR_ATtiny85__) && (F_CPU == 16000000L)
   clock_prescale_set(clock_div_1); // Enable 16 MHz on Trinket
@@ -178,6 +278,13 @@ void setup() {
   mystrip->show();
 
   pixel = 0;
+
+  palette.Load(kModePalettes[0]);
+  for (uint16_t i = 0; i < nLEDS; i++) {
+    paletteOffsets[i] = i * kPaletteSize / nLEDS;
+  }
+
+  StartButton();
 }
 
 #ifndef ARDUINO
@@ -189,135 +296,121 @@ long millis() {
 }
 #endif
 
-uint32_t iterations = 0;
+Color PaletteAt(uint8_t index) {
+  const PaletteColor& color = palette.At(index);
+  return Color(color.red, color.green, color.blue);
+}
 
-//Input a value 0 to 384 to get a color value.
-//The colours are a transition r - g -b - back to r
-
-Color Wheel(uint16_t WheelPos)
-{
-  byte r, g, b;
-  switch(WheelPos / 128)
-  {
-    case 0:
-      r = 127 - WheelPos % 128;   //Red down
-      g = WheelPos % 128;      // Green up
-      b = 0;                  //blue off
-      break; 
-    case 1:
-      g = 127 - WheelPos % 128;  //green down
-      b = WheelPos % 128;      //blue up
-      r = 0;                  //red off
-      break; 
-    case 2:
-      b = 127 - WheelPos % 128;  //blue down 
-      r = WheelPos % 128;      //red up
-      g = 0;                  //green off
-      break; 
+// Only a new mode changes the palette, and then gradually.
+void SetMode(byte mode) {
+  if (mode != ledMode) {
+    ledMode = mode;
+    palette.SetTarget(kModePalettes[mode]);
   }
-  return(Color(ColorTuple(r,g,b)));
 }
 
-// Slightly different, this one makes the rainbow wheel equally distributed 
-// along the chain
-void rainbowCycle() {
-  uint16_t i, j;
-  for (j=0; j < 384; j++) {     // 5 cycles of all 384 colors in the wheel
-
-    for (i=0; i < mystrip->numPixels(); i++) {
-      // tricky math! we use each pixel as a fraction of the full 384-color wheel
-      // (thats the i / strip.numPixels() part)
-      // Then add in j which makes the colors go around per pixel
-      // the % 384 is to make the wheel cycle around
-      mystrip->setPixelColor(i, Wheel( ((i * 384 / mystrip->numPixels()) + j) % 384) );
-    }  
-    mystrip->show();   // write all the pixels out
-
-    delay(1);
+void HandleButton() {
+  ButtonEvent event;
+  while (button.Pop(&event)) {
+    if (event == kButtonPress) {
+      byte next = (ledMode + 1) % kModeCount;
+      SetMode(next);
+      // The next automatic change is a full mode's time away.
+      iterations = next * 30;
+      modeChanged = true;
+    } else {
+      autoAdvance = !autoAdvance;
+      // Carry on from this mode.
+      iterations = ledMode * 30;
+    }
   }
 }
 
-Color RedYellowWheel(uint16_t WheelPos) {
-  byte r, g, b;
-  switch(WheelPos / 64)
-  {
-    case 0:
-      r = 127 - WheelPos % 64;   //Red down
-      g = (WheelPos % 64) / 3;      // Green up
-      b = 0;                  //blue off
-      break; 
-    case 1:
-      g = (64 - WheelPos % 64) / 3;  //green down
-      r = 64 + WheelPos % 64;      //red up
-      b = 0;                  //blue off
-      break; 
-  }
-  return(Color(ColorTuple(r,g,b)));
+// Sends the frame, waits `ms` and moves any palette blend on a step.
+// Returns true if the button changed the mode, and the effect should
+// stop.
+bool NextFrame(uint8_t ms) {
+  mystrip->show();
+  palette.Step(kPaletteBlendStep);
+
+  delay(ms);
+  HandleButton();
+  return modeChanged;
 }
 
-void redYellowCycle() {
-  uint16_t i, j;
-  
-  for (j=0; j < 128; j++) {
-    for (i=0; i < mystrip->numPixels(); i++) {
-      mystrip->setPixelColor(i, RedYellowWheel(((i * 128 / mystrip->numPixels()) + j) % 128));
+// Scrolls the palette along every strand, `speed` steps a frame, until
+// it has gone all the way round.
+void scrollCycle(uint8_t speed, uint8_t ms) {
+  for (uint16_t j = 0; j < kPaletteSize; j += speed) {
+    for (uint16_t i = 0; i < nLEDS; i++) {
+      mystrip->setPixelColor(i, PaletteAt(paletteOffsets[i] + j));
+    }
+    if (NextFrame(ms)) {
+      return;
     }
-    mystrip->show();
-
-    delay(4);
   }
 }
 
-Color BlueWheel(uint16_t WheelPos) {
-  byte r, g, b;
-  switch(WheelPos / 64)
-  {
-    case 0:
-      b = 96 - WheelPos % 64;   //blue down
-      r = (WheelPos % 64) / 2;      // red up
-      g = 0;                  //blue off
-      break; 
-    case 1:
-      r = (64 - WheelPos % 64) / 2;  //red down
-      b = 32 + WheelPos % 64;      //blue up
-      g = 0;                  //green off
-      break; 
+// The palette wound round the tube, turning.
+void spiralCycle() {
+  for (uint16_t j = 0; j < 256; j += 2) {
+    for (uint16_t led = 0; led < kGeometryLeds; led++) {
+      mystrip->setLedColor(led, PaletteAt(GeometryAngle(kGeometry, led)
+                                          + GeometryZ(kGeometry, led) + j));
+    }
+    if (NextFrame(4)) {
+      return;
+    }
   }
-  return(Color(ColorTuple(r,g,b)));
 }
 
-void blueCycle() {
-  uint16_t i, j;
-  
-  for (j=0; j < 128; j++) {
-    for (i=0; i < mystrip->numPixels(); i++) {
-      mystrip->setPixelColor(i, BlueWheel(((i * 128 / mystrip->numPixels()) + j) % 128));
+// Fills the tube from the bottom up and empties it again, the palette
+// going round it.
+void wipeCycle() {
+  for (uint16_t j = 0; j < 512; j += 4) {
+    uint8_t level = j < 256 ? j : 511 - j;
+    for (uint16_t led = 0; led < kGeometryLeds; led++) {
+      if (GeometryZ(kGeometry, led) <= level) {
+        mystrip->setLedColor(led, PaletteAt(GeometryAngle(kGeometry, led)
+                                            + j));
+      } else {
+        mystrip->setLedColor(led, Color());
+      }
+    }
+    if (NextFrame(4)) {
+      return;
     }
-    mystrip->show();
-
-    delay(4);
   }
 }
 
-
 void loop() {
-  switch((iterations / 30) % 3) {
-  case 0:
-    rainbowCycle();
-    break;
-  case 1:
-    // Runs in 1/3rd the time, so run it 3 times.
-    redYellowCycle();
-    redYellowCycle();
-    redYellowCycle();
-    break;
-  case 2:
-    // Runs in 1/3rd the time, so run it 3 times.
-    blueCycle();
-    blueCycle();
-    blueCycle();
-    break;
+  if (autoAdvance) {
+    SetMode((iterations / 30) % kModeCount);
+  }
+  modeChanged = false;
+
+  // The shorter effects run 3 times, to take about as long as the
+  // rainbow.
+  byte passes = ledMode == kModeRainbow ? 1 : 3;
+  for (byte pass = 0; pass < passes && !modeChanged; pass++) {
+    switch (ledMode) {
+    case kModeRainbow:
+      scrollCycle(1, 1);
+      break;
+    case kModeRedYellow:
+    case kModeBlue:
+      scrollCycle(2, 4);
+      break;
+    case kModeSpiral:
+      spiralCycle();
+      break;
+    case kModeWipe:
+      wipeCycle();
+      break;
+    }
   }
 
-  iterations++;
+  if (!modeChanged) {
+    iterations++;
+  }
 }
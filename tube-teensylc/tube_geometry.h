@@ -0,0 +1,184 @@
+// Generated by tools/gen-geometry 8 22; do not edit.
+
+#include "geometry.h"
+
+#define kGeometryLeds 176
+
+const LedPoint kGeometry[kGeometryLeds] PROGMEM = {
+  { 127,    0,   0,   0, 255},
+  { 127,    0,  12,   0, 255},
+  { 127,    0,  24,   0, 255},
+  { 127,    0,  36,   0, 255},
+  { 127,    0,  49,   0, 255},
+  { 127,    0,  61,   0, 255},
+  { 127,    0,  73,   0, 255},
+  { 127,    0,  85,   0, 255},
+  { 127,    0,  97,   0, 255},
+  { 127,    0, 109,   0, 255},
+  { 127,    0, 121,   0, 255},
+  { 127,    0, 134,   0, 255},
+  { 127,    0, 146,   0, 255},
+  { 127,    0, 158,   0, 255},
+  { 127,    0, 170,   0, 255},
+  { 127,    0, 182,   0, 255},
+  { 127,    0, 194,   0, 255},
+  { 127,    0, 206,   0, 255},
+  { 127,    0, 219,   0, 255},
+  { 127,    0, 231,   0, 255},
+  { 127,    0, 243,   0, 255},
+  { 127,    0, 255,   0, 255},
+  {  90,   90,   0,  32, 255},
+  {  90,   90,  12,  32, 255},
+  {  90,   90,  24,  32, 255},
+  {  90,   90,  36,  32, 255},
+  {  90,   90,  49,  32, 255},
+  {  90,   90,  61,  32, 255},
+  {  90,   90,  73,  32, 255},
+  {  90,   90,  85,  32, 255},
+  {  90,   90,  97,  32, 255},
+  {  90,   90, 109,  32, 255},
+  {  90,   90, 121,  32, 255},
+  {  90,   90, 134,  32, 255},
+  {  90,   90, 146,  32, 255},
+  {  90,   90, 158,  32, 255},
+  {  90,   90, 170,  32, 255},
+  {  90,   90, 182,  32, 255},
+  {  90,   90, 194,  32, 255},
+  {  90,   90, 206,  32, 255},
+  {  90,   90, 219,  32, 255},
+  {  90,   90, 231,  32, 255},
+  {  90,   90, 243,  32, 255},
+  {  90,   90, 255,  32, 255},
+  {   0,  127,   0,  64, 255},
+  {   0,  127,  12,  64, 255},
+  {   0,  127,  24,  64, 255},
+  {   0,  127,  36,  64, 255},
+  {   0,  127,  49,  64, 255},
+  {   0,  127,  61,  64, 255},
+  {   0,  127,  73,  64, 255},
+  {   0,  127,  85,  64, 255},
+  {   0,  127,  97,  64, 255},
+  {   0,  127, 109,  64, 255},
+  {   0,  127, 121,  64, 255},
+  {   0,  127, 134,  64, 255},
+  {   0,  127, 146,  64, 255},
+  {   0,  127, 158,  64, 255},
+  {   0,  127, 170,  64, 255},
+  {   0,  127, 182,  64, 255},
+  {   0,  127, 194,  64, 255},
+  {   0,  127, 206,  64, 255},
+  {   0,  127, 219,  64, 255},
+  {   0,  127, 231,  64, 255},
+  {   0,  127, 243,  64, 255},
+  {   0,  127, 255,  64, 255},
+  { -90,   90,   0,  96, 255},
+  { -90,   90,  12,  96, 255},
+  { -90,   90,  24,  96, 255},
+  { -90,   90,  36,  96, 255},
+  { -90,   90,  49,  96, 255},
+  { -90,   90,  61,  96, 255},
+  { -90,   90,  73,  96, 255},
+  { -90,   90,  85,  96, 255},
+  { -90,   90,  97,  96, 255},
+  { -90,   90, 109,  96, 255},
+  { -90,   90, 121,  96, 255},
+  { -90,   90, 134,  96, 255},
+  { -90,   90, 146,  96, 255},
+  { -90,   90, 158,  96, 255},
+  { -90,   90, 170,  96, 255},
+  { -90,   90, 182,  96, 255},
+  { -90,   90, 194,  96, 255},
+  { -90,   90, 206,  96, 255},
+  { -90,   90, 219,  96, 255},
+  { -90,   90, 231,  96, 255},
+  { -90,   90, 243,  96, 255},
+  { -90,   90, 255,  96, 255},
+  {-127,    0,   0, 128, 255},
+  {-127,    0,  12, 128, 255},
+  {-127,    0,  24, 128, 255},
+  {-127,    0,  36, 128, 255},
+  {-127,    0,  49, 128, 255},
+  {-127,    0,  61, 128, 255},
+  {-127,    0,  73, 128, 255},
+  {-127,    0,  85, 128, 255},
+  {-127,    0,  97, 128, 255},
+  {-127,    0, 109, 128, 255},
+  {-127,    0, 121, 128, 255},
+  {-127,    0, 134, 128, 255},
+  {-127,    0, 146, 128, 255},
+  {-127,    0, 158, 128, 255},
+  {-127,    0, 170, 128, 255},
+  {-127,    0, 182, 128, 255},
+  {-127,    0, 194, 128, 255},
+  {-127,    0, 206, 128, 255},
+  {-127,    0, 219, 128, 255},
+  {-127,    0, 231, 128, 255},
+  {-127,    0, 243, 128, 255},
+  {-127,    0, 255, 128, 255},
+  { -90,  -90,   0, 160, 255},
+  { -90,  -90,  12, 160, 255},
+  { -90,  -90,  24, 160, 255},
+  { -90,  -90,  36, 160, 255},
+  { -90,  -90,  49, 160, 255},
+  { -90,  -90,  61, 160, 255},
+  { -90,  -90,  73, 160, 255},
+  { -90,  -90,  85, 160, 255},
+  { -90,  -90,  97, 160, 255},
+  { -90,  -90, 109, 160, 255},
+  { -90,  -90, 121, 160, 255},
+  { -90,  -90, 134, 160, 255},
+  { -90,  -90, 146, 160, 255},
+  { -90,  -90, 158, 160, 255},
+  { -90,  -90, 170, 160, 255},
+  { -90,  -90, 182, 160, 255},
+  { -90,  -90, 194, 160, 255},
+  { -90,  -90, 206, 160, 255},
+  { -90,  -90, 219, 160, 255},
+  { -90,  -90, 231, 160, 255},
+  { -90,  -90, 243, 160, 255},
+  { -90,  -90, 255, 160, 255},
+  {   0, -127,   0, 192, 255},
+  {   0, -127,  12, 192, 255},
+  {   0, -127,  24, 192, 255},
+  {   0, -127,  36, 192, 255},
+  {   0, -127,  49, 192, 255},
+  {   0, -127,  61, 192, 255},
+  {   0, -127,  73, 192, 255},
+  {   0, -127,  85, 192, 255},
+  {   0, -127,  97, 192, 255},
+  {   0, -127, 109, 192, 255},
+  {   0, -127, 121, 192, 255},
+  {   0, -127, 134, 192, 255},
+  {   0, -127, 146, 192, 255},
+  {   0, -127, 158, 192, 255},
+  {   0, -127, 170, 192, 255},
+  {   0, -127, 182, 192, 255},
+  {   0, -127, 194, 192, 255},
+  {   0, -127, 206, 192, 255},
+  {   0, -127, 219, 192, 255},
+  {   0, -127, 231, 192, 255},
+  {   0, -127, 243, 192, 255},
+  {   0, -127, 255, 192, 255},
+  {  90,  -90,   0, 224, 255},
+  {  90,  -90,  12, 224, 255},
+  {  90,  -90,  24, 224, 255},
+  {  90,  -90,  36, 224, 255},
+  {  90,  -90,  49, 224, 255},
+  {  90,  -90,  61, 224, 255},
+  {  90,  -90,  73, 224, 255},
+  {  90,  -90,  85, 224, 255},
+  {  90,  -90,  97, 224, 255},
+  {  90,  -90, 109, 224, 255},
+  {  90,  -90, 121, 224, 255},
+  {  90,  -90, 134, 224, 255},
+  {  90,  -90, 146, 224, 255},
+  {  90,  -90, 158, 224, 255},
+  {  90,  -90, 170, 224, 255},
+  {  90,  -90, 182, 224, 255},
+  {  90,  -90, 194, 224, 255},
+  {  90,  -90, 206, 224, 255},
+  {  90,  -90, 219, 224, 255},
+  {  90,  -90, 231, 224, 255},
+  {  90,  -90, 243, 224, 255},
+  {  90,  -90, 255, 224, 255},
+};